@@ -0,0 +1,111 @@
+#include "benchworld.h"
+#include "chunk.h"
+#include "occupancy.h"
+#include "worldgen/pipeline.h"
+#include "worldgen/worldgen.h"
+
+#include <threads.h>
+
+#include <vector>
+
+static bool isWithin(int32_t x, int32_t z, int32_t radius)
+{
+	return x >= -radius && x <= radius && z >= -radius && z <= radius;
+}
+
+void buildBenchWorld(World& world, uint32_t seed, int32_t radius)
+{
+	// Decorating a chunk needs its neighbours through the chunk local stages, completing it needs them decorated
+	const int32_t decorateRadius = radius + 1;
+	const int32_t generateRadius = radius + 2;
+
+	for (int32_t z = -generateRadius; z <= generateRadius; ++z)
+	{
+		for (int32_t x = -generateRadius; x <= generateRadius; ++x)
+		{
+			ChunkColumn* column = new ChunkColumn();
+			column->x = x;
+			column->z = z;
+			generateColumn(*column, seed);
+			world.columns[{ x, z }] = column;
+
+			for (int32_t y = 0; y < WorldHeightChunks; ++y)
+			{
+				Chunk* chunk = new Chunk();
+				chunk->x = x;
+				chunk->y = y;
+				chunk->z = z;
+				chunk->blocks.resize(ChunkVoxelCount);
+				generateDensity(*chunk, *column, seed);
+				generateSurface(*chunk, *column, seed);
+				generateCaves(*chunk, seed);
+				world.chunks[{ x, y, z }] = chunk;
+			}
+		}
+	}
+
+	for (int32_t z = -decorateRadius; z <= decorateRadius; ++z)
+	{
+		for (int32_t x = -decorateRadius; x <= decorateRadius; ++x)
+		{
+			const ChunkColumn& column = *findColumn(world, { x, z });
+			for (int32_t y = 0; y < WorldHeightChunks; ++y)
+			{
+				Chunk* neighbourhood[27];
+				for (int32_t offsetZ = -1; offsetZ <= 1; ++offsetZ)
+				{
+					for (int32_t offsetY = -1; offsetY <= 1; ++offsetY)
+					{
+						for (int32_t offsetX = -1; offsetX <= 1; ++offsetX)
+						{
+							neighbourhood[getNeighbourhoodIndex(offsetX, offsetY, offsetZ)] = findChunk(world, { x + offsetX, y + offsetY, z + offsetZ });
+						}
+					}
+				}
+				generateDecorations(neighbourhood, column, seed);
+			}
+		}
+	}
+
+	for (auto& entry : world.chunks)
+	{
+		Chunk& chunk = *entry.second;
+		if (!isWithin(chunk.x, chunk.z, radius))
+			continue;
+
+		chunk.isComplete = true;
+		updateChunkOccupancy(chunk);
+		updateColumnInfo(*findColumn(world, { chunk.x, chunk.z }), chunk);
+	}
+}
+
+size_t generatePipelineWorld(World& world, int32_t radius, uint32_t workerCount, CWorldStorage* storage)
+{
+	CWorldGenPipeline pipeline;
+	if (!pipeline.Init(&world, workerCount, storage))
+		return 0;
+
+	size_t requestedCount = 0;
+	for (int32_t z = -radius; z <= radius; ++z)
+	{
+		for (int32_t x = -radius; x <= radius; ++x)
+		{
+			for (int32_t y = 0; y < WorldHeightChunks; ++y)
+			{
+				pipeline.Request({ x, y, z });
+				++requestedCount;
+			}
+		}
+	}
+
+	std::vector<Chunk*> completed;
+	for (size_t completedCount = 0; completedCount < requestedCount; completedCount += completed.size())
+	{
+		completed.clear();
+		pipeline.Update(completed);
+		thrd_yield();
+	}
+
+	pipeline.Deinit();
+	return requestedCount;
+}
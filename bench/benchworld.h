@@ -0,0 +1,48 @@
+#pragma once
+
+#include "world.h"
+
+#include <stdint.h>
+
+#include <chrono>
+
+class CWorldStorage;
+
+constexpr uint32_t BenchSeed = 0x5eed1234;
+
+// Generates the chunk columns within radius of column 0, 0 on the calling thread and completes them the way the
+// world gen pipeline does. Unlike the pipeline, stages run in a fixed order so the same seed always gives the
+// same blocks. The chunks of the ring around the radius are generated too but stay incomplete
+void buildBenchWorld(World& world, uint32_t seed, int32_t radius);
+
+// Requests every chunk within radius of column 0, 0 from the world gen pipeline, running on workerCount threads
+// and loading saved chunks from the optional storage, and waits until all of them are complete. Returns the
+// number of chunks requested
+size_t generatePipelineWorld(World& world, int32_t radius, uint32_t workerCount, CWorldStorage* storage = nullptr);
+
+inline double getElapsedMs(std::chrono::steady_clock::time_point start)
+{
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+// Small deterministic generator, so runs don't depend on the C library's rand()
+struct BenchRandom
+{
+	uint32_t state;
+
+	uint32_t Next()
+	{
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	// Uniform in [min, max)
+	float NextFloat(float min, float max)
+	{
+		return min + (max - min) * static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f);
+	}
+};
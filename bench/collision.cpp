@@ -0,0 +1,182 @@
+// Collision test and benchmark: drops player sized boxes onto the world and moves them around with gravity, jumps and
+// random walking, a few of them fast enough to cross several blocks per move. Fails when a box ends a move
+// overlapping a solid block or when two runs over the same world don't end up with exactly the same boxes
+
+#include "benchworld.h"
+#include "chunk.h"
+#include "collision.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+constexpr int32_t WorldRadius = 4;
+constexpr uint32_t BoxCount = 1000;
+constexpr uint32_t MoveCount = 1000;
+
+constexpr float BoxHalfWidth = 0.3f;
+constexpr float BoxHeight = 1.8f;
+constexpr float Gravity = 0.08f;
+constexpr float MaxFallSpeed = 3.0f;
+constexpr float JumpSpeed = 0.42f;
+
+struct Body
+{
+	Aabb box;
+	glm::vec3 velocity;
+};
+
+struct RunResult
+{
+	std::vector<Body> bodies;
+	uint32_t overlapCount;
+	uint32_t blockedCount;
+	double ms;
+};
+
+// Same rounding as moveAabb(), a face on a block boundary doesn't overlap the block beyond it
+static BlockBox getOverlappedBlocks(const Aabb& box)
+{
+	return
+	{
+		static_cast<int32_t>(floorf(box.min.x)),
+		static_cast<int32_t>(floorf(box.min.y)),
+		static_cast<int32_t>(floorf(box.min.z)),
+		static_cast<int32_t>(ceilf(box.max.x)) - 1,
+		static_cast<int32_t>(ceilf(box.max.y)) - 1,
+		static_cast<int32_t>(ceilf(box.max.z)) - 1
+	};
+}
+
+static std::vector<Body> spawnBodies(const World& world)
+{
+	// Incomplete chunks count as solid, the ring around the complete ones walls the boxes in
+	const float extent = static_cast<float>(WorldRadius * static_cast<int32_t>(ChunkWidth)) - 1.0f;
+	const float top = static_cast<float>(WorldHeightChunks * static_cast<int32_t>(ChunkHeight)) - BoxHeight - 0.1f;
+
+	BenchRandom random = { 0x6c8e9cf5u };
+	std::vector<Body> bodies;
+	while (bodies.size() < BoxCount)
+	{
+		const glm::vec3 min(random.NextFloat(-extent, extent), top, random.NextFloat(-extent, extent));
+
+		Body body;
+		body.box = { min, min + glm::vec3(2.0f * BoxHalfWidth, BoxHeight, 2.0f * BoxHalfWidth) };
+		body.velocity = glm::vec3(0.0f);
+		if (!isBoxSolid(world, getOverlappedBlocks(body.box)))
+		{
+			bodies.push_back(body);
+		}
+	}
+	return bodies;
+}
+
+static RunResult run(const World& world)
+{
+	RunResult result = { spawnBodies(world), 0, 0, 0.0 };
+	BenchRandom random = { 0x1b873593u };
+
+	const auto start = std::chrono::steady_clock::now();
+	for (uint32_t moveIt = 0; moveIt < MoveCount; ++moveIt)
+	{
+		for (uint32_t bodyIt = 0; bodyIt < BoxCount; ++bodyIt)
+		{
+			Body& body = result.bodies[bodyIt];
+
+			// Every tenth box runs fast enough to cross a few blocks per move
+			const float maxSpeed = bodyIt % 10 == 0 ? 2.5f : 0.3f;
+			if (random.Next() % 16 == 0)
+			{
+				body.velocity.x = random.NextFloat(-maxSpeed, maxSpeed);
+				body.velocity.z = random.NextFloat(-maxSpeed, maxSpeed);
+			}
+			body.velocity.y = fmaxf(body.velocity.y - Gravity, -MaxFallSpeed);
+
+			const MoveResult move = moveAabb(world, body.box, body.velocity);
+			for (int32_t axis = 0; axis < 3; ++axis)
+			{
+				if (move.isBlocked[axis])
+				{
+					++result.blockedCount;
+					// Landed, sometimes jump right away. Walls stop the box until it picks a new direction
+					body.velocity[axis] = axis == 1 && body.velocity.y < 0.0f && random.Next() % 8 == 0 ? JumpSpeed : 0.0f;
+				}
+			}
+
+			if (isBoxSolid(world, getOverlappedBlocks(body.box)))
+			{
+				if (result.overlapCount == 0)
+				{
+					printf("Box %u overlaps a solid block after move %u at %.3f %.3f %.3f\n",
+						bodyIt, moveIt, body.box.min.x, body.box.min.y, body.box.min.z);
+				}
+				++result.overlapCount;
+			}
+		}
+	}
+	result.ms = getElapsedMs(start);
+
+	return result;
+}
+
+static uint32_t getChecksum(const std::vector<Body>& bodies)
+{
+	// FNV-1a over the exact bits of the boxes
+	uint32_t hash = 2166136261u;
+	for (const Body& body : bodies)
+	{
+		const float values[6] = { body.box.min.x, body.box.min.y, body.box.min.z, body.box.max.x, body.box.max.y, body.box.max.z };
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+		for (size_t byteIt = 0; byteIt < sizeof(values); ++byteIt)
+		{
+			hash = (hash ^ bytes[byteIt]) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+static bool isSameBodies(const std::vector<Body>& a, const std::vector<Body>& b)
+{
+	for (size_t bodyIt = 0; bodyIt < a.size(); ++bodyIt)
+	{
+		if (memcmp(&a[bodyIt].box, &b[bodyIt].box, sizeof(Aabb)) != 0)
+			return false;
+	}
+	return a.size() == b.size();
+}
+
+int main()
+{
+	World world;
+	initWorld(world, BenchSeed);
+
+	const auto start = std::chrono::steady_clock::now();
+	buildBenchWorld(world, world.seed, WorldRadius);
+	printf("Built %zu chunks in %.1f ms\n", world.chunks.size(), getElapsedMs(start));
+
+	const RunResult first = run(world);
+	const RunResult second = run(world);
+
+	const uint32_t moveCount = BoxCount * MoveCount;
+	printf("%u boxes x %u moves: %.2f M moves/sec, %.0f ns/move, %.1f%% of the axes blocked, checksum %08x\n",
+		BoxCount, MoveCount, moveCount / first.ms / 1000.0, first.ms * 1000000.0 / moveCount,
+		100.0 * first.blockedCount / (3.0 * moveCount), getChecksum(first.bodies));
+
+	bool isPassed = true;
+	if (first.overlapCount != 0)
+	{
+		printf("FAILED: %u moves ended overlapping a solid block\n", first.overlapCount);
+		isPassed = false;
+	}
+	if (!isSameBodies(first.bodies, second.bodies) || first.blockedCount != second.blockedCount)
+	{
+		printf("FAILED: a second run ended with different boxes, checksum %08x\n", getChecksum(second.bodies));
+		isPassed = false;
+	}
+
+	deinitWorld(world);
+	return isPassed ? 0 : 1;
+}
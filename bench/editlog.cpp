@@ -0,0 +1,140 @@
+// Edit log throughput: appends batches of edits to complete chunks once per frame, then flushes them like the main
+// loop does. The flush only hands the batch to the I/O worker, which writes and syncs it while the next frame's edits
+// are appended. The final fold waits for the worker, so its time includes the outstanding syncs of the file system
+// the log lives on. Pass a directory on the file system to measure, the default is /tmp
+
+#include "benchworld.h"
+#include "chunk.h"
+#include "editlog.h"
+#include "storage.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+constexpr int32_t WorldRadius = 3;
+constexpr uint32_t FrameCount = 128;
+constexpr uint32_t BatchSizes[] = { 1, 64, 4096 };
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+	return remove(path);
+}
+
+static bool runBatchSize(World& world, const std::string& directory, uint32_t batchSize)
+{
+	CWorldStorage storage;
+	if (!storage.Init(directory.c_str(), world.seed))
+		return false;
+
+	CEditLog editLog;
+	if (!editLog.Init(&storage))
+	{
+		storage.Deinit();
+		return false;
+	}
+
+	std::vector<Chunk*> chunks;
+	for (auto& entry : world.chunks)
+	{
+		if (entry.second->isComplete)
+		{
+			chunks.push_back(entry.second);
+		}
+	}
+	std::sort(chunks.begin(), chunks.end(), [](const Chunk* a, const Chunk* b)
+	{
+		return a->x != b->x ? a->x < b->x : a->z != b->z ? a->z < b->z : a->y < b->y;
+	});
+
+	BenchRandom random = { 0x9e3779b9u };
+	double appendMs = 0.0;
+	double updateMs = 0.0;
+	std::vector<double> flushMs;
+	bool isFlushed = true;
+
+	for (uint32_t frame = 0; frame < FrameCount; ++frame)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t editIt = 0; editIt < batchSize; ++editIt)
+		{
+			Chunk& chunk = *chunks[random.Next() % chunks.size()];
+			const uint32_t voxelIndex = random.Next() % ChunkVoxelCount;
+			const uint32_t oldBlock = static_cast<const Chunk&>(chunk).blocks[voxelIndex];
+			const uint32_t newBlock = random.Next() % 8;
+
+			chunk.blocks[voxelIndex] = newBlock;
+			markVoxelEdited(chunk, voxelIndex);
+			editLog.Append({ chunk.x, chunk.y, chunk.z }, voxelIndex, oldBlock, newBlock);
+		}
+		appendMs += getElapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		isFlushed = editLog.Flush() && isFlushed;
+		flushMs.push_back(getElapsedMs(start));
+
+		start = std::chrono::steady_clock::now();
+		editLog.Update(world);
+		updateMs += getElapsedMs(start);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	editLog.Deinit(world);
+	const double deinitMs = getElapsedMs(start);
+	storage.Deinit();
+
+	double totalFlushMs = 0.0;
+	for (double ms : flushMs)
+	{
+		totalFlushMs += ms;
+	}
+	std::sort(flushMs.begin(), flushMs.end());
+
+	const uint32_t editCount = batchSize * FrameCount;
+	const double loggedMb = editCount * sizeof(EditRecord) / (1024.0 * 1024.0);
+	printf("%5u edits/frame: append %.1f M edits/sec, flush avg %.3f ms p50 %.3f ms max %.3f ms, "
+		"update avg %.3f ms, %.2f MB logged, final fold %.1f ms\n",
+		batchSize, editCount / appendMs / 1000.0, totalFlushMs / FrameCount, flushMs[FrameCount / 2], flushMs.back(),
+		updateMs / FrameCount, loggedMb, deinitMs);
+
+	if (!isFlushed)
+	{
+		printf("Flushing the edit log failed\n");
+	}
+	return isFlushed;
+}
+
+int main(int argc, char** argv)
+{
+	const std::string parent = argc > 1 ? argv[1] : "/tmp";
+
+	World world;
+	initWorld(world, BenchSeed);
+
+	auto start = std::chrono::steady_clock::now();
+	buildBenchWorld(world, world.seed, WorldRadius);
+	printf("Built %zu chunks in %.1f ms, logging to %s\n", world.chunks.size(), getElapsedMs(start), parent.c_str());
+
+	bool isPassed = true;
+	for (uint32_t batchSize : BatchSizes)
+	{
+		std::string directory = parent + "/editlog-XXXXXX";
+		if (!mkdtemp(&directory[0]))
+		{
+			printf("Could not create a directory in %s\n", parent.c_str());
+			isPassed = false;
+			break;
+		}
+
+		isPassed = runBatchSize(world, directory, batchSize) && isPassed;
+		nftw(directory.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	}
+
+	deinitWorld(world);
+	return isPassed ? 0 : 1;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// Stand-in for glad on the host. chunk.h only needs the GL types of VisualChunk, nothing is drawn
+#include <stddef.h>
+
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef ptrdiff_t GLsizeiptr;
+
+#define GL_UNSIGNED_SHORT 0x1403
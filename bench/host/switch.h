@@ -0,0 +1,3 @@
+#pragma once
+
+// Stand-in for libnx on the host. The simulation code only uses the C library through nxlink.h
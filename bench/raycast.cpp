@@ -0,0 +1,79 @@
+// Raycast throughput: casts rays in random directions from eye height above the ground, at the pick distance the
+// game uses and at a longer distance that mostly crosses empty and missing chunks
+
+#include "benchworld.h"
+#include "chunk.h"
+#include "raycast.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+constexpr int32_t WorldRadius = 4;
+constexpr uint32_t RayCount = 1000000;
+constexpr float EyeHeight = 1.6f;
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+static std::vector<Ray> makeRays(const World& world)
+{
+	// Stay a chunk away from the incomplete ring so that long rays still cross the world
+	const float extent = static_cast<float>(WorldRadius * static_cast<int32_t>(ChunkWidth));
+
+	BenchRandom random = { 0x2545f491u };
+	std::vector<Ray> rays(RayCount);
+	for (Ray& ray : rays)
+	{
+		const float x = random.NextFloat(-extent, extent);
+		const float z = random.NextFloat(-extent, extent);
+		const ColumnInfo* info = findColumnInfo(world, static_cast<int32_t>(floorf(x)), static_cast<int32_t>(floorf(z)));
+		const float ground = info ? static_cast<float>(info->height + 1) : 0.0f;
+
+		ray.origin = glm::vec3(x, ground + EyeHeight, z);
+		ray.direction = glm::vec3(random.NextFloat(-1.0f, 1.0f), random.NextFloat(-1.0f, 1.0f), random.NextFloat(-1.0f, 1.0f));
+	}
+	return rays;
+}
+
+static void castRays(const World& world, const std::vector<Ray>& rays, float maxDistance)
+{
+	uint32_t hitCount = 0;
+	uint32_t checksum = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+	for (const Ray& ray : rays)
+	{
+		RaycastHit hit;
+		if (raycastBlocks(world, ray.origin, ray.direction, maxDistance, hit))
+		{
+			++hitCount;
+			checksum = checksum * 31 + static_cast<uint32_t>(hit.x * 73856093 ^ hit.y * 19349663 ^ hit.z * 83492791) + hit.face;
+		}
+	}
+	const double ms = getElapsedMs(start);
+
+	printf("%4.0f blocks: %.2f M rays/sec, %.0f ns/ray, %.1f%% hit, checksum %08x\n",
+		maxDistance, rays.size() / ms / 1000.0, ms * 1000000.0 / rays.size(), 100.0 * hitCount / rays.size(), checksum);
+}
+
+int main()
+{
+	World world;
+	initWorld(world, BenchSeed);
+
+	const auto start = std::chrono::steady_clock::now();
+	buildBenchWorld(world, world.seed, WorldRadius + 1);
+	printf("Built %zu chunks in %.1f ms\n", world.chunks.size(), getElapsedMs(start));
+
+	const std::vector<Ray> rays = makeRays(world);
+	castRays(world, rays, 8.0f);
+	castRays(world, rays, 64.0f);
+
+	deinitWorld(world);
+	return 0;
+}
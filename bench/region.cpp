@@ -0,0 +1,193 @@
+// Region file throughput: saves the chunks of a world into region files and loads them back, once with every chunk
+// stored in full and once with a few edits per chunk so that they are stored as diffs. Loading a diff only reads
+// the edits, generating the chunk they apply to isn't part of it. Fails when a loaded chunk doesn't match the saved
+// one. Pass a directory on the file system to measure, the default is /tmp
+
+#include "benchworld.h"
+#include "chunk.h"
+#include "storage.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+constexpr int32_t WorldRadius = 6;
+constexpr uint32_t DiffEditCount = 64;
+
+static size_t g_regionBytes;
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+	return remove(path);
+}
+
+static int addRegionSize(const char* path, const struct stat* fileStat, int type, struct FTW*)
+{
+	if (type == FTW_F && std::string(path).find(".region") != std::string::npos)
+	{
+		g_regionBytes += static_cast<size_t>(fileStat->st_size);
+	}
+	return 0;
+}
+
+static std::vector<ChunkSnapshot> makeFullChunks(const std::vector<const Chunk*>& chunks)
+{
+	std::vector<ChunkSnapshot> savedChunks;
+	savedChunks.reserve(chunks.size());
+	for (const Chunk* chunk : chunks)
+	{
+		savedChunks.push_back(getChunkSnapshot(*chunk));
+		savedChunks.back().editMask.assign(ChunkVoxelCount / 64, ~uint64_t(0));
+	}
+	return savedChunks;
+}
+
+static bool isVoxelEdited(const ChunkSnapshot& chunk, size_t voxelIndex)
+{
+	return (chunk.editMask[voxelIndex / 64] >> (voxelIndex % 64)) & 1;
+}
+
+static std::vector<ChunkSnapshot> makeDiffChunks(const std::vector<const Chunk*>& chunks)
+{
+	BenchRandom random = { 0x85ebca6bu };
+	std::vector<ChunkSnapshot> savedChunks;
+	savedChunks.reserve(chunks.size());
+	for (const Chunk* chunk : chunks)
+	{
+		savedChunks.push_back(getChunkSnapshot(*chunk));
+		ChunkSnapshot& savedChunk = savedChunks.back();
+		savedChunk.editMask.assign(ChunkVoxelCount / 64, 0);
+		for (uint32_t editIt = 0; editIt < DiffEditCount; ++editIt)
+		{
+			const uint32_t voxelIndex = random.Next() % ChunkVoxelCount;
+			savedChunk.blocks[voxelIndex] = random.Next() % 8;
+			savedChunk.editMask[voxelIndex / 64] |= uint64_t(1) << (voxelIndex % 64);
+		}
+	}
+	return savedChunks;
+}
+
+static bool isSameLoad(const ChunkSnapshot& saved, const Chunk& loaded, RegionChunkKind kind, const std::vector<VoxelEdit>& diff)
+{
+	if (kind == RegionChunkFull)
+	{
+		for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; ++voxelIt)
+		{
+			if (saved.blocks[voxelIt] != loaded.blocks[voxelIt])
+				return false;
+		}
+		return true;
+	}
+
+	size_t editedCount = 0;
+	for (uint64_t mask : saved.editMask)
+	{
+		editedCount += static_cast<size_t>(__builtin_popcountll(mask));
+	}
+	if (kind != RegionChunkDiff || diff.size() != editedCount)
+		return false;
+
+	for (const VoxelEdit& edit : diff)
+	{
+		if (edit.voxelIndex >= ChunkVoxelCount || !isVoxelEdited(saved, edit.voxelIndex) || saved.blocks[edit.voxelIndex] != edit.block)
+			return false;
+	}
+	return true;
+}
+
+static bool runKind(const std::string& parent, const char* name, const std::vector<ChunkSnapshot>& savedChunks, uint32_t seed)
+{
+	std::string directory = parent + "/region-XXXXXX";
+	if (!mkdtemp(&directory[0]))
+	{
+		printf("Could not create a directory in %s\n", parent.c_str());
+		return false;
+	}
+
+	bool isPassed = true;
+
+	CWorldStorage storage;
+	auto start = std::chrono::steady_clock::now();
+	if (!storage.Init(directory.c_str(), seed) || !storage.SaveChunks(savedChunks))
+	{
+		printf("Could not save the chunks\n");
+		isPassed = false;
+	}
+	const double saveMs = getElapsedMs(start);
+	storage.Deinit();
+
+	g_regionBytes = 0;
+	nftw(directory.c_str(), addRegionSize, 16, FTW_PHYS);
+	const double regionMb = g_regionBytes / (1024.0 * 1024.0);
+
+	// A new storage opens the region files again, as on the next start
+	uint32_t mismatchCount = 0;
+	std::vector<VoxelEdit> diff;
+	Chunk loaded;
+	loaded.blocks.resize(ChunkVoxelCount);
+
+	start = std::chrono::steady_clock::now();
+	isPassed = isPassed && storage.Init(directory.c_str(), seed);
+	for (size_t chunkIt = 0; chunkIt < savedChunks.size() && isPassed; ++chunkIt)
+	{
+		const ChunkSnapshot& saved = savedChunks[chunkIt];
+		loaded.x = saved.x;
+		loaded.y = saved.y;
+		loaded.z = saved.z;
+		diff.clear();
+
+		const RegionChunkKind kind = storage.LoadChunk(loaded, diff);
+		mismatchCount += !isSameLoad(saved, loaded, kind, diff);
+	}
+	const double loadMs = getElapsedMs(start);
+	storage.Deinit();
+
+	printf("%s: %zu chunks, %.2f MB of region files, save %.0f chunks/sec %.1f MB/sec, load %.0f chunks/sec %.1f MB/sec\n",
+		name, savedChunks.size(), regionMb, savedChunks.size() / saveMs * 1000.0, regionMb / saveMs * 1000.0,
+		savedChunks.size() / loadMs * 1000.0, regionMb / loadMs * 1000.0);
+
+	if (mismatchCount != 0)
+	{
+		printf("FAILED: %u loaded chunks don't match the saved ones\n", mismatchCount);
+		isPassed = false;
+	}
+
+	nftw(directory.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return isPassed;
+}
+
+int main(int argc, char** argv)
+{
+	const std::string parent = argc > 1 ? argv[1] : "/tmp";
+
+	World world;
+	initWorld(world, BenchSeed);
+
+	const auto start = std::chrono::steady_clock::now();
+	buildBenchWorld(world, world.seed, WorldRadius);
+	printf("Built %zu chunks in %.1f ms, saving to %s\n", world.chunks.size(), getElapsedMs(start), parent.c_str());
+
+	std::vector<const Chunk*> chunks;
+	for (const auto& entry : world.chunks)
+	{
+		if (entry.second->isComplete)
+		{
+			chunks.push_back(entry.second);
+		}
+	}
+	std::sort(chunks.begin(), chunks.end(), [](const Chunk* a, const Chunk* b)
+	{
+		return a->x != b->x ? a->x < b->x : a->z != b->z ? a->z < b->z : a->y < b->y;
+	});
+
+	bool isPassed = runKind(parent, "Full", makeFullChunks(chunks), world.seed);
+	isPassed = runKind(parent, "Diff", makeDiffChunks(chunks), world.seed) && isPassed;
+
+	deinitWorld(world);
+	return isPassed ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// Saved chunk test: generates a world, saves some of its chunks in full and generates it again with them loaded.
+// Fails when a chunk of the second world differs from the first, which happens when decorations of saved chunks
+// don't reach their neighbours or decorations of other chunks get lost next to saved ones. Saved chunks are laid
+// out in whole columns and in a 3D checkerboard, which stacks saved and unsaved chunks on top of each other
+// and puts them on each other's diagonals
+
+#include "benchworld.h"
+#include "chunk.h"
+#include "storage.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+constexpr int32_t WorldRadius = 2;
+constexpr int32_t SavedRadius = 1;
+constexpr uint32_t WorkerCount = 3;
+
+typedef bool (*SavedLayout)(const ChunkCoord& coord);
+
+static bool isColumnSaved(const ChunkCoord& coord)
+{
+	return (coord.x + coord.z) % 2 == 0;
+}
+
+static bool isCheckerboardSaved(const ChunkCoord& coord)
+{
+	return (coord.x + coord.y + coord.z) % 2 == 0;
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+	return remove(path);
+}
+
+static bool runLayout(const World& fresh, const char* name, SavedLayout isSaved)
+{
+	std::string directory = "/tmp/savedchunks-XXXXXX";
+	if (!mkdtemp(&directory[0]))
+	{
+		printf("Could not create a directory in /tmp\n");
+		return false;
+	}
+
+	// Saving in full needs every voxel marked as edited, the fresh world itself stays as it is
+	std::vector<ChunkSnapshot> savedChunks;
+	for (int32_t z = -SavedRadius; z <= SavedRadius; ++z)
+	{
+		for (int32_t x = -SavedRadius; x <= SavedRadius; ++x)
+		{
+			for (int32_t y = 0; y < WorldHeightChunks; ++y)
+			{
+				if (isSaved({ x, y, z }))
+				{
+					savedChunks.push_back(getChunkSnapshot(*findChunk(fresh, { x, y, z })));
+					savedChunks.back().editMask.assign(ChunkVoxelCount / 64, ~uint64_t(0));
+				}
+			}
+		}
+	}
+
+	CWorldStorage storage;
+	bool isPassed = storage.Init(directory.c_str(), fresh.seed) && storage.SaveChunks(savedChunks);
+	if (!isPassed)
+	{
+		printf("Could not save the chunks\n");
+	}
+
+	World loaded;
+	initWorld(loaded, fresh.seed);
+	if (isPassed)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const size_t chunkCount = generatePipelineWorld(loaded, WorldRadius, WorkerCount, &storage);
+		const double ms = getElapsedMs(start);
+
+		uint32_t differentCount = 0;
+		for (const auto& entry : fresh.chunks)
+		{
+			const Chunk& freshChunk = *entry.second;
+			const Chunk* loadedChunk = findChunk(loaded, entry.first);
+			if (!freshChunk.isComplete || !loadedChunk || !loadedChunk->isComplete)
+				continue;
+
+			uint32_t voxelCount = 0;
+			for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; ++voxelIt)
+			{
+				voxelCount += freshChunk.blocks[voxelIt] != loadedChunk->blocks[voxelIt];
+			}
+
+			if (voxelCount != 0)
+			{
+				printf("Chunk %d, %d, %d differs in %u voxels\n", entry.first.x, entry.first.y, entry.first.z, voxelCount);
+				++differentCount;
+			}
+		}
+
+		printf("%s: %zu chunks saved, %zu generated in %.1f ms, %u differ\n", name, savedChunks.size(), chunkCount, ms, differentCount);
+		if (differentCount != 0)
+		{
+			printf("FAILED: the world with saved chunks differs from the fresh one\n");
+			isPassed = false;
+		}
+	}
+
+	deinitWorld(loaded);
+	storage.Deinit();
+	nftw(directory.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return isPassed;
+}
+
+int main()
+{
+	World fresh;
+	initWorld(fresh, BenchSeed);
+
+	const auto start = std::chrono::steady_clock::now();
+	const size_t chunkCount = generatePipelineWorld(fresh, WorldRadius, WorkerCount);
+	printf("Generated %zu chunks in %.1f ms\n", chunkCount, getElapsedMs(start));
+
+	bool isPassed = runLayout(fresh, "Saved columns", isColumnSaved);
+	isPassed = runLayout(fresh, "Saved checkerboard", isCheckerboardSaved) && isPassed;
+
+	deinitWorld(fresh);
+	return isPassed ? 0 : 1;
+}
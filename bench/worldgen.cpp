@@ -0,0 +1,114 @@
+// World gen throughput: generates the terrain of a square of chunk columns on the calling thread with
+// generateTerrain(), then a world through the pipeline with its decorations on worker threads. Both report
+// chunks/sec and a checksum of the blocks, which only depends on the seed. Fails when generating the same
+// chunks again gives a different checksum
+
+#include "benchworld.h"
+#include "chunk.h"
+#include "worldgen/worldgen.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+constexpr int32_t TerrainRadius = 16;
+constexpr int32_t PipelineRadius = 8;
+constexpr uint32_t WorkerCount = 3;
+
+static uint32_t addChecksum(uint32_t hash, const Chunk& chunk)
+{
+	// FNV-1a over the blocks
+	for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; ++voxelIt)
+	{
+		const uint32_t block = chunk.blocks[voxelIt];
+		hash = (hash ^ block) * 16777619u;
+	}
+	return hash;
+}
+
+static uint32_t runTerrain()
+{
+	Chunk chunk;
+	chunk.blocks.resize(ChunkVoxelCount);
+
+	uint32_t checksum = 2166136261u;
+	uint32_t chunkCount = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int32_t z = -TerrainRadius; z < TerrainRadius; ++z)
+	{
+		for (int32_t x = -TerrainRadius; x < TerrainRadius; ++x)
+		{
+			for (int32_t y = 0; y < WorldHeightChunks; ++y)
+			{
+				chunk.x = x;
+				chunk.y = y;
+				chunk.z = z;
+				generateTerrain(chunk, BenchSeed);
+				checksum = addChecksum(checksum, chunk);
+				++chunkCount;
+			}
+		}
+	}
+	const double ms = getElapsedMs(start);
+
+	printf("Terrain: %u chunks on 1 thread, %.0f chunks/sec, %.1f us/chunk, checksum %08x\n",
+		chunkCount, chunkCount / ms * 1000.0, ms * 1000.0 / chunkCount, checksum);
+	return checksum;
+}
+
+static uint32_t runPipeline()
+{
+	World world;
+	initWorld(world, BenchSeed);
+
+	const auto start = std::chrono::steady_clock::now();
+	const size_t chunkCount = generatePipelineWorld(world, PipelineRadius, WorkerCount);
+	const double ms = getElapsedMs(start);
+
+	// The pipeline completes chunks in any order, sum them up in a fixed one
+	std::vector<const Chunk*> chunks;
+	for (const auto& entry : world.chunks)
+	{
+		if (entry.second->isComplete)
+		{
+			chunks.push_back(entry.second);
+		}
+	}
+	std::sort(chunks.begin(), chunks.end(), [](const Chunk* a, const Chunk* b)
+	{
+		return a->x != b->x ? a->x < b->x : a->z != b->z ? a->z < b->z : a->y < b->y;
+	});
+
+	uint32_t checksum = 2166136261u;
+	for (const Chunk* chunk : chunks)
+	{
+		checksum = addChecksum(checksum, *chunk);
+	}
+
+	printf("Pipeline: %zu complete chunks of %zu generated on %u workers, %.0f chunks/sec, checksum %08x\n",
+		chunkCount, world.chunks.size(), WorkerCount, chunkCount / ms * 1000.0, checksum);
+
+	deinitWorld(world);
+	return checksum;
+}
+
+int main()
+{
+	const uint32_t terrainChecksum = runTerrain();
+	const uint32_t pipelineChecksum = runPipeline();
+
+	bool isPassed = true;
+	if (runTerrain() != terrainChecksum)
+	{
+		printf("FAILED: generating the terrain again gave a different checksum\n");
+		isPassed = false;
+	}
+	if (runPipeline() != pipelineChecksum)
+	{
+		printf("FAILED: generating the world again gave a different checksum\n");
+		isPassed = false;
+	}
+	return isPassed ? 0 : 1;
+}
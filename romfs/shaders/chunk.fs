@@ -4,14 +4,29 @@
 //uniform vec4 g_color = vec4(1, 1, 1, 1);
 
 const vec3 g_sunDirection = vec3(0.3, 1, 0.7);
+const vec3 g_blockLightColor = vec3(1.0, 0.85, 0.6);
+const float g_occlusionStrength = 0.5;
 
 in vec2 texcoord;
 in vec3 normal;
 
+// Smoothed sky and block light level of the corner divided by the highest level, and its
+// ambient occlusion from 0 in a crevice to 1 in the open
+in vec3 light;
+
 out vec4 color;
 
+// Every light level is a fixed fraction darker than the one above it, level 0 is not quite black
+float getLightIntensity(float level)
+{
+	return pow(0.8, (1.0 - level) * 15.0);
+}
+
 void main()
 {
 	float sunPower = dot(normal, normalize(-g_sunDirection)) * 0.5f;
-	color = 0.5 + sunPower * vec4(1, 1, 1, 1);
+	vec3 skyColor = vec3(0.5 + sunPower) * getLightIntensity(light.x);
+	vec3 blockColor = g_blockLightColor * getLightIntensity(light.y);
+	float occlusion = 1.0 - g_occlusionStrength * (1.0 - light.z);
+	color = vec4(max(skyColor, blockColor) * occlusion, 1);
 }
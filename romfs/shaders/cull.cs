@@ -29,74 +29,146 @@ layout(std430, binding = 3) buffer indirectArgBuffer
     DrawElementsIndirectCommand g_indirectArgs;
 };
 
-layout(location = 0) uniform uint g_quadCount;
+// Quads are grouped in clusters of up to 64 quads of the same face direction, see QuadCluster in chunk.cpp
+struct QuadCluster
+{
+    vec3 boundsMin;
+    uint firstQuad;
+    vec3 boundsMax;
+    uint quadCount;
+    vec3 coneApex;
+    float coneCutoff;
+    vec3 coneAxis;
+    float padding;
+};
+
+layout(std430, binding = 4) readonly buffer clusterBuffer
+{
+    QuadCluster g_clusters[];
+};
+
 layout(location = 1) uniform mat4 g_matViewProj;
+// Ranges of clusters to cull as (first cluster, cluster count), the face buckets facing away from the camera are left out
+layout(location = 2) uniform uint g_clusterRangeCount;
+layout(location = 3) uniform uvec2 g_clusterRanges[6];
+layout(location = 9) uniform vec4 g_frustumPlanes[6];
+layout(location = 15) uniform vec3 g_cameraPos;
+// Index buffers hold 16-bit indices packed in pairs unless the chunk is too dense for them
+layout(location = 16) uniform bool g_use32BitIndices;
+
+shared bool s_isClusterVisible;
+shared QuadCluster s_cluster;
 
 void unpackIndices(uint packedIndices, out uint first, out uint second)
 {
-    first = packedIndices >> 16;
-    second = packedIndices & 0xffffu;
+    // Little endian, the first 16-bit index of a pair is in the low half
+    first = packedIndices & 0xffffu;
+    second = packedIndices >> 16;
+}
+
+vec3 loadPosition(uint index)
+{
+    return vec3(
+        g_positions[index * 3 + 0],
+        g_positions[index * 3 + 1],
+        g_positions[index * 3 + 2]
+    );
+}
+
+bool isOutside(vec3 distance0, vec3 distance1, vec3 distance2, vec3 distance3)
+{
+    bvec3 outside = lessThan(max(max(distance0, distance1), max(distance2, distance3)), vec3(0));
+    return any(outside);
+}
+
+bool isClusterVisible(QuadCluster cluster)
+{
+    for (int planeIt = 0; planeIt < 6; ++planeIt)
+    {
+        vec4 plane = g_frustumPlanes[planeIt];
+        vec3 farCorner = mix(cluster.boundsMin, cluster.boundsMax, greaterThan(plane.xyz, vec3(0)));
+        if (dot(plane.xyz, farCorner) + plane.w < 0)
+            return false;
+    }
+
+    // Every quad in the cluster faces away from the camera when it is inside the cone behind the apex
+    vec3 apexToCamera = cluster.coneApex - g_cameraPos;
+    return dot(apexToCamera, cluster.coneAxis) < cluster.coneCutoff * length(apexToCamera);
 }
 
 layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
 void main()
 {
-    if (gl_GlobalInvocationID.x == 0)
+    // g_indirectArgs.count is reset by the CPU before the dispatch, the remaining
+    // fields are constant and set up when the buffer is created
+
+    // One work group per cluster, the first invocation rejects the whole cluster for the group
+    if (gl_LocalInvocationIndex == 0)
     {
-        g_indirectArgs.count = 0;
-        g_indirectArgs.primCount = 1;
-        g_indirectArgs.firstIndex = 0;
-        g_indirectArgs.baseVertex = 0;
-        g_indirectArgs.baseInstance = 0;
+        uint clusterId = gl_WorkGroupID.x;
+        for (uint rangeIt = 0; rangeIt < g_clusterRangeCount; ++rangeIt)
+        {
+            if (clusterId < g_clusterRanges[rangeIt].y)
+            {
+                clusterId += g_clusterRanges[rangeIt].x;
+                break;
+            }
+            clusterId -= g_clusterRanges[rangeIt].y;
+        }
+
+        s_cluster = g_clusters[clusterId];
+        s_isClusterVisible = isClusterVisible(s_cluster);
     }
 
-    uint quadId = gl_GlobalInvocationID.x;
-    if (quadId < g_quadCount)
+    barrier();
+
+    if (s_isClusterVisible && gl_LocalInvocationIndex < s_cluster.quadCount)
     {
-        uint packedIndices0 = g_indices[quadId * 3 + 0];
-        uint packedIndices1 = g_indices[quadId * 3 + 1];
-        uint packedIndices2 = g_indices[quadId * 3 + 2];
+        uint quadId = s_cluster.firstQuad + gl_LocalInvocationIndex;
 
         uint indices[6];
-        unpackIndices(packedIndices0, indices[0], indices[1]);
-        unpackIndices(packedIndices1, indices[2], indices[3]);
-        unpackIndices(packedIndices2, indices[4], indices[5]);
-
-        vec3 vertexPos0 = vec3(
-            g_positions[indices[0] * 3 + 0],
-            g_positions[indices[0] * 3 + 1],
-            g_positions[indices[0] * 3 + 2]
-        );
-        vec3 vertexPos1 = vec3(
-            g_positions[indices[1] * 3 + 0],
-            g_positions[indices[1] * 3 + 1],
-            g_positions[indices[1] * 3 + 2]
-        );
-        vec3 vertexPos2 = vec3(
-            g_positions[indices[2] * 3 + 0],
-            g_positions[indices[2] * 3 + 1],
-            g_positions[indices[2] * 3 + 2]
-        );
-
-        vec4 ndc0 = g_matViewProj * vec4(vertexPos0, 1);
-        vec4 ndc1 = g_matViewProj * vec4(vertexPos1, 1);
-        vec4 ndc2 = g_matViewProj * vec4(vertexPos2, 1);
-
-        vec2 ndcMin = min(min(ndc0.xy, ndc1.xy), ndc2.xy);
-        vec2 ndcMax = max(max(ndc0.xy, ndc1.xy), ndc2.xy);
-
-        bool isCulled = ndcMax.x < 0 || ndcMax.y < 0 || ndcMin.x > 0 || ndcMin.y > 0;
-
-        isCulled = vertexPos0.x > 0.0f;
+        if (g_use32BitIndices)
+        {
+            for (uint indexIt = 0; indexIt < 6; ++indexIt)
+            {
+                indices[indexIt] = g_indices[quadId * 6 + indexIt];
+            }
+        }
+        else
+        {
+            unpackIndices(g_indices[quadId * 3 + 0], indices[0], indices[1]);
+            unpackIndices(g_indices[quadId * 3 + 1], indices[2], indices[3]);
+            unpackIndices(g_indices[quadId * 3 + 2], indices[4], indices[5]);
+        }
+
+        // Quads are emitted as (0, 1, 2), (2, 1, 3), indices 0, 1, 2 and 5 are the four corners
+        vec4 clip0 = g_matViewProj * vec4(loadPosition(indices[0]), 1);
+        vec4 clip1 = g_matViewProj * vec4(loadPosition(indices[1]), 1);
+        vec4 clip2 = g_matViewProj * vec4(loadPosition(indices[2]), 1);
+        vec4 clip3 = g_matViewProj * vec4(loadPosition(indices[5]), 1);
+
+        // Culled when all corners are outside the same clip plane
+        bool isCulled =
+            isOutside(clip0.xyz + clip0.w, clip1.xyz + clip1.w, clip2.xyz + clip2.w, clip3.xyz + clip3.w) ||
+            isOutside(clip0.w - clip0.xyz, clip1.w - clip1.xyz, clip2.w - clip2.xyz, clip3.w - clip3.xyz);
 
         if (!isCulled)
         {
             uint outBaseIndex = atomicAdd(g_indirectArgs.count, 6);
-            uint outBufferIndex = outBaseIndex / 2;
-            g_outIndices[outBufferIndex + 0] = packedIndices0;
-            g_outIndices[outBufferIndex + 1] = packedIndices1;
-            g_outIndices[outBufferIndex + 2] = packedIndices2;
+            if (g_use32BitIndices)
+            {
+                for (uint indexIt = 0; indexIt < 6; ++indexIt)
+                {
+                    g_outIndices[outBaseIndex + indexIt] = indices[indexIt];
+                }
+            }
+            else
+            {
+                uint outBufferIndex = outBaseIndex / 2;
+                g_outIndices[outBufferIndex + 0] = indices[0] | (indices[1] << 16);
+                g_outIndices[outBufferIndex + 1] = indices[2] | (indices[3] << 16);
+                g_outIndices[outBufferIndex + 2] = indices[4] | (indices[5] << 16);
+            }
         }
     }
 }
-
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+// Block IDs as stored in Chunk::blocks
+enum BlockType : uint32_t
+{
+	BlockAir = 0,
+	BlockStone,
+	BlockDirt,
+	BlockGrass,
+	BlockCoalOre,
+	BlockIronOre,
+	// Decorations, in increasing priority when they overlap
+	BlockLeaves,
+	BlockLog,
+	// Placed by the player only
+	BlockLamp,
+	BlockTypeCount
+};
+
+inline bool isSolidBlock(uint32_t block)
+{
+	return block != BlockAir;
+}
+
+// Light levels go from 0 in the dark to MaxLightLevel, every block of air light passes through costs a level
+constexpr uint8_t MaxLightLevel = 15;
+
+// Block light a block gives off, 0 for blocks that don't glow
+inline uint8_t getLightEmission(uint32_t block)
+{
+	return block == BlockLamp ? MaxLightLevel : 0;
+}
@@ -0,0 +1,142 @@
+#include "blockstorage.h"
+#include "nxlink.h"
+
+#include "tracy/Tracy.hpp"
+#include "tracy/common/tracy_lz4.hpp"
+
+std::atomic<uint32_t> BlockStorage::s_accessTime(0);
+
+static std::atomic<uint32_t> g_compressedCount(0);
+static std::atomic<uint64_t> g_compressedBytes(0);
+static std::atomic<uint64_t> g_uncompressedBytes(0);
+static std::atomic<uint64_t> g_accessCount(0);
+static std::atomic<uint64_t> g_missCount(0);
+
+// Shared by the copies of a compressed storage, counted in the stats for as long as it lives
+struct BlockStorage::CompressedBlocks
+{
+	std::vector<char> data;
+	size_t uncompressedSize;
+
+	~CompressedBlocks()
+	{
+		g_compressedCount.fetch_sub(1, std::memory_order_relaxed);
+		g_compressedBytes.fetch_sub(data.size(), std::memory_order_relaxed);
+		g_uncompressedBytes.fetch_sub(uncompressedSize, std::memory_order_relaxed);
+	}
+};
+
+BlockStorage::BlockStorage(const BlockStorage& other)
+	: _blocks(other._blocks)
+	, _compressed(other._compressed)
+	, _count(other._count)
+	, _lastAccessTime(other._lastAccessTime)
+	, _isShared(true)
+{
+	other._isShared = true;
+}
+
+BlockStorage& BlockStorage::operator=(const BlockStorage& other)
+{
+	if (this != &other)
+	{
+		_blocks = other._blocks;
+		_compressed = other._compressed;
+		_count = other._count;
+		_lastAccessTime = other._lastAccessTime;
+		_isShared = true;
+		other._isShared = true;
+	}
+	return *this;
+}
+
+void BlockStorage::resize(size_t count)
+{
+	_blocks = std::make_shared<std::vector<uint32_t>>(count);
+	_compressed.reset();
+	_count = count;
+	_lastAccessTime = getAccessTime();
+	_isShared = false;
+}
+
+bool BlockStorage::compressIfAccessedBefore(uint32_t accessTime)
+{
+	// Shared blocks are never written, so they can be read here while a snapshot holds on to them. Their memory
+	// is freed once the snapshot lets go
+	if (!_blocks || _lastAccessTime >= accessTime)
+		return false;
+
+	ZoneScoped;
+
+	const int uncompressedSize = static_cast<int>(_count * sizeof(uint32_t));
+
+	std::vector<char> data(tracy::LZ4_compressBound(uncompressedSize));
+	const int compressedSize = tracy::LZ4_compress_default(reinterpret_cast<const char*>(_blocks->data()), data.data(), uncompressedSize, static_cast<int>(data.size()));
+	if (compressedSize <= 0)
+		return false;
+
+	data.resize(compressedSize);
+	data.shrink_to_fit();
+
+	std::shared_ptr<CompressedBlocks> compressed = std::make_shared<CompressedBlocks>();
+	compressed->data.swap(data);
+	compressed->uncompressedSize = static_cast<size_t>(uncompressedSize);
+
+	g_compressedCount.fetch_add(1, std::memory_order_relaxed);
+	g_compressedBytes.fetch_add(compressed->data.size(), std::memory_order_relaxed);
+	g_uncompressedBytes.fetch_add(compressed->uncompressedSize, std::memory_order_relaxed);
+
+	_compressed = std::move(compressed);
+	_blocks.reset();
+	_isShared = false;
+	return true;
+}
+
+BlockStorageStats BlockStorage::getStats()
+{
+	BlockStorageStats stats;
+	stats.compressedCount = g_compressedCount.load(std::memory_order_relaxed);
+	stats.compressedBytes = g_compressedBytes.load(std::memory_order_relaxed);
+	stats.uncompressedBytes = g_uncompressedBytes.load(std::memory_order_relaxed);
+	stats.accessCount = g_accessCount.load(std::memory_order_relaxed);
+	stats.missCount = g_missCount.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void BlockStorage::touchSlow() const
+{
+	_lastAccessTime = getAccessTime();
+	g_accessCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (_blocks)
+		return;
+
+	ZoneScoped;
+
+	g_missCount.fetch_add(1, std::memory_order_relaxed);
+
+	const int uncompressedSize = static_cast<int>(_count * sizeof(uint32_t));
+	std::shared_ptr<std::vector<uint32_t>> blocks = std::make_shared<std::vector<uint32_t>>(_count);
+
+	const int decompressedSize = tracy::LZ4_decompress_safe(_compressed->data.data(), reinterpret_cast<char*>(blocks->data()), static_cast<int>(_compressed->data.size()), uncompressedSize);
+	if (decompressedSize != uncompressedSize)
+	{
+		// Only happens when memory got corrupted, there is no way to recover the blocks
+		TRACE("Could not decompress %zu blocks", _count);
+	}
+
+	_blocks = std::move(blocks);
+	_compressed.reset();
+	_isShared = false;
+}
+
+void BlockStorage::makeUnique()
+{
+	touch();
+
+	if (_isShared)
+	{
+		_blocks = std::make_shared<std::vector<uint32_t>>(*_blocks);
+		_isShared = false;
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct BlockStorageStats
+{
+	uint32_t compressedCount;
+	uint64_t compressedBytes;
+	// Size of the compressed blocks before compression
+	uint64_t uncompressedBytes;
+	// Accesses are counted at most once per storage and access time, misses had to decompress
+	uint64_t accessCount;
+	uint64_t missCount;
+};
+
+// Block array of a chunk, shared between copies until they write to it. Copying a chunk is
+// therefore an O(1) snapshot. The non-const accessors make the storage unique first, so take a
+// pointer once in hot loops rather than indexing the storage per voxel. Copies may live on other
+// threads but each copy must only be used by one thread at a time.
+//
+// Blocks that weren't accessed for a while can be LZ4 compressed in place, any accessor
+// transparently decompresses them again.
+class BlockStorage
+{
+public:
+	BlockStorage() = default;
+	// Both the copy and the original copy the blocks before their next write
+	BlockStorage(const BlockStorage& other);
+	BlockStorage& operator=(const BlockStorage& other);
+	BlockStorage(BlockStorage&& other) = default;
+	BlockStorage& operator=(BlockStorage&& other) = default;
+
+	size_t size() const { return _count; }
+	// Replaces the content with count air blocks
+	void resize(size_t count);
+
+	const uint32_t* data() const { touch(); return _blocks->data(); }
+	const uint32_t& operator[](size_t index) const { return data()[index]; }
+	const uint32_t* begin() const { return data(); }
+	const uint32_t* end() const { return data() + size(); }
+
+	uint32_t* data() { makeUnique(); return _blocks->data(); }
+	uint32_t& operator[](size_t index) { return data()[index]; }
+	uint32_t* begin() { return data(); }
+	uint32_t* end() { return data() + size(); }
+
+	bool isShared() const { return _isShared; }
+	bool isCompressed() const { return _compressed != nullptr; }
+
+	// Compresses the blocks when they were last accessed before accessTime, true if it did
+	bool compressIfAccessedBefore(uint32_t accessTime);
+
+	// Time stamp stored on every access, in seconds. Set by the main thread once per frame
+	static void setAccessTime(uint32_t time) { s_accessTime.store(time, std::memory_order_relaxed); }
+	static uint32_t getAccessTime() { return s_accessTime.load(std::memory_order_relaxed); }
+	static BlockStorageStats getStats();
+
+private:
+	struct CompressedBlocks;
+
+	void touch() const
+	{
+		if (!_blocks || _lastAccessTime != getAccessTime())
+		{
+			touchSlow();
+		}
+	}
+
+	void touchSlow() const;
+	void makeUnique();
+
+	mutable std::shared_ptr<std::vector<uint32_t>> _blocks;
+	mutable std::shared_ptr<const CompressedBlocks> _compressed;
+	size_t _count = 0;
+	mutable uint32_t _lastAccessTime = 0;
+	// Set on both sides of a copy while they may share _blocks. Unlike the use count of _blocks, which copies
+	// on other threads change whenever they let go, it only changes on the thread using this copy
+	mutable bool _isShared = false;
+
+	static std::atomic<uint32_t> s_accessTime;
+};
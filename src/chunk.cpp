@@ -1,265 +1,1115 @@
 #include "chunk.h"
+#include "block.h"
+#include "light.h"
+#include "occupancy.h"
 #include "renderer/renderer.h"
 
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <random>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
 
 bool VisualChunk::s_triangleFilteringEnabled = true;
 bool VisualChunk::s_freezeCulling = false;
 
 static GLuint g_cullShaderProgram;
 
-constexpr size_t ChunkWidth = 16;
-constexpr size_t ChunkHeight = 16;
-constexpr size_t ChunkDepth = 16;
+// Every frame is fenced, once beginFrame() returns all frames up to
+// g_frameNumber - FrameCount have completed on the GPU.
+static uint64_t g_frameNumber = 0;
+static uint32_t g_frameSlot = 0;
+static GLsync g_frameFences[VisualChunk::FrameCount] = {};
 
-constexpr size_t ChunkVoxelCount = ChunkWidth * ChunkHeight * ChunkDepth;
+enum FrustumState : uint8_t
+{
+	FrustumOutside,
+	FrustumIntersecting,
+	FrustumInside
+};
 
-void initChunk(Chunk& chunk, int32_t x, int32_t y, int32_t z)
+struct alignas(64) DrawElementsIndirectCommand
 {
-	chunk.x = x;
-	chunk.y = y;
-	chunk.z = z;
+	uint count;
+	uint primCount;
+	uint firstIndex;
+	uint baseVertex;
+	uint baseInstance;
+};
 
-	chunk.blocks.resize(ChunkVoxelCount);
+void VisualChunk::init()
+{
+	g_cullShaderProgram = loadComputeShaderProgram("romfs:/shaders/cull.cs");
+}
 
-	//const int32_t chunkX = x * ChunkWidth;
-	//const int32_t chunkY = y * ChunkHeight;
-	//const int32_t chunkZ = z * ChunkDepth;
+void VisualChunk::deinit()
+{
+	for (GLsync& fence : g_frameFences)
+	{
+		if (fence)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
 
-	std::mt19937 random;
-	std::bernoulli_distribution dist(0.1);
+	glDeleteProgram(g_cullShaderProgram);
+}
 
-	for (int32_t voxelIt = 0; voxelIt < static_cast<int32_t>(ChunkVoxelCount); ++voxelIt)
+void VisualChunk::beginFrame()
+{
+	// Wait until the GPU has finished the frame that last used this slot, after
+	// that nothing reads this slot's culled buffers anymore and we can overwrite them
+	GLsync& fence = g_frameFences[g_frameSlot];
+	if (fence)
 	{
-		//const int32_t voxelX = chunkX + (voxelIt % ChunkWidth);
-		//const int32_t voxelY = chunkY + ((voxelIt / ChunkWidth) % ChunkHeight);
-		//const int32_t voxelZ = chunkZ + ((voxelIt / ChunkWidth) / ChunkHeight);
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+		{
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
 
-		chunk.blocks[voxelIt] = dist(random);
+		glDeleteSync(fence);
+		fence = nullptr;
 	}
 }
 
-void VisualChunk::init()
+void VisualChunk::syncCulling()
 {
-	g_cullShaderProgram = loadComputeShaderProgram("romfs:/shaders/cull.cs");
+	if (s_triangleFilteringEnabled && !s_freezeCulling)
+	{
+		// The draws source their index data and indirect args from buffers the cull shader wrote,
+		// one barrier after all dispatches lets the driver overlap the dispatches themselves
+		glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	}
 }
 
-void VisualChunk::deinit()
+void VisualChunk::endFrame()
 {
-	glDeleteProgram(g_cullShaderProgram);
+	g_frameFences[g_frameSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	g_frameSlot = (g_frameSlot + 1) % FrameCount;
+	++g_frameNumber;
+}
+
+// A run of up to ClusterQuadCount quads of one face direction, culled as a whole before its quads are.
+// Matches the std430 layout of QuadCluster in cull.cs
+struct QuadCluster
+{
+	glm::vec3 boundsMin;
+	uint32_t firstQuad;
+	glm::vec3 boundsMax;
+	uint32_t quadCount;
+	glm::vec3 coneApex;
+	float coneCutoff;
+	glm::vec3 coneAxis;
+	float padding;
+};
+
+// One cull shader work group handles one cluster
+constexpr uint32_t ClusterQuadCount = 64;
+
+// Quads are grouped by face direction, the transparent quads of all directions follow as one more group
+constexpr uint32_t QuadGroupCount = FaceDirectionCount + 1;
+constexpr uint32_t TransparentQuadGroup = FaceDirectionCount;
+
+constexpr size_t SectionVoxelCount = ChunkWidth * ChunkHeight * ChunkSectionDepth;
+
+// Buckets are ordered by group, then section, so the quads of one face direction stay contiguous
+static uint32_t getQuadBucket(uint32_t group, uint32_t section)
+{
+	return group * ChunkSectionCount + section;
+}
+
+// Outward facing normal of every FaceDirection
+static const glm::vec3 g_faceDirectionVectors[FaceDirectionCount] =
+{
+	glm::vec3(0, 0, -1),
+	glm::vec3(0, 0, 1),
+	glm::vec3(0, -1, 0),
+	glm::vec3(0, 1, 0),
+	glm::vec3(-1, 0, 0),
+	glm::vec3(1, 0, 0),
+};
+
+struct FaceDesc
+{
+	glm::vec3 corners[4];
+	glm::vec3 normal;
+};
+
+// Indexed by FaceDirection, corners are emitted as the triangles (0, 1, 2), (2, 1, 3)
+static const FaceDesc g_faceDescs[FaceDirectionCount] =
+{
+	{ { glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0) }, glm::vec3(0, 0, 1) },
+	{ { glm::vec3(0, 0, 1), glm::vec3(1, 0, 1), glm::vec3(0, 1, 1), glm::vec3(1, 1, 1) }, glm::vec3(0, 0, -1) },
+	{ { glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(1, 0, 1) }, glm::vec3(0, 1, 0) },
+	{ { glm::vec3(0, 1, 0), glm::vec3(1, 1, 0), glm::vec3(0, 1, 1), glm::vec3(1, 1, 1) }, glm::vec3(0, -1, 0) },
+	{ { glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 1) }, glm::vec3(1, 0, 0) },
+	{ { glm::vec3(1, 0, 0), glm::vec3(1, 1, 0), glm::vec3(1, 0, 1), glm::vec3(1, 1, 1) }, glm::vec3(-1, 0, 0) },
+};
+
+// The triangles share the diagonal between corners 1 and 2, flipped quads start at corner 1 to share the one
+// between corners 0 and 3 instead
+static void addFace(FaceDirection direction, const glm::vec3& pos, const uint32_t cornerLights[4], bool isFlipped, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals, std::vector<uint32_t>& lights)
+{
+	static const uint8_t cornerOrders[2][4] = { { 0, 1, 2, 3 }, { 1, 3, 0, 2 } };
+
+	const FaceDesc& face = g_faceDescs[direction];
+
+	for (uint8_t corner : cornerOrders[isFlipped])
+	{
+		positions.push_back(pos + face.corners[corner]);
+		normals.push_back(face.normal);
+		lights.push_back(cornerLights[corner]);
+	}
+}
+
+// Fills the cluster slots of a bucket, positions holds the corners of its quads. Slots past the last quad stay empty
+static void buildClusters(FaceDirection direction, uint32_t firstQuad, const std::vector<glm::vec3>& positions, uint32_t clusterCount, QuadCluster* outClusters)
+{
+	const glm::vec3& axis = g_faceDirectionVectors[direction];
+	const bool isPositive = (direction & 1) != 0;
+	const uint32_t quadCount = static_cast<uint32_t>(positions.size() / 4);
+
+	for (uint32_t clusterIt = 0; clusterIt < clusterCount; ++clusterIt)
+	{
+		const uint32_t clusterQuad = clusterIt * ClusterQuadCount;
+
+		QuadCluster& cluster = outClusters[clusterIt];
+		cluster.firstQuad = firstQuad + clusterQuad;
+		cluster.quadCount = clusterQuad < quadCount ? std::min(ClusterQuadCount, quadCount - clusterQuad) : 0;
+		cluster.boundsMin = glm::vec3(FLT_MAX);
+		cluster.boundsMax = glm::vec3(-FLT_MAX);
+
+		for (uint32_t vertexIt = clusterQuad * 4; vertexIt < (clusterQuad + cluster.quadCount) * 4; ++vertexIt)
+		{
+			cluster.boundsMin = glm::min(cluster.boundsMin, positions[vertexIt]);
+			cluster.boundsMax = glm::max(cluster.boundsMax, positions[vertexIt]);
+		}
+
+		// All quads share the normal so the cone has no spread, a cutoff of zero makes the
+		// cone the half space behind the rearmost face, where every face is seen from behind
+		cluster.coneAxis = axis;
+		cluster.coneApex = isPositive ? cluster.boundsMin : cluster.boundsMax;
+		cluster.coneCutoff = 0.0f;
+		cluster.padding = 0.0f;
+	}
+}
+
+// Quads are 4 consecutive vertices, the index buffers only depend on the quad slots they cover
+static void buildQuadIndices(uint32_t firstQuad, uint32_t endQuad, std::vector<uint32_t>& outIndices)
+{
+	outIndices.reserve((endQuad - firstQuad) * 6);
+	for (uint32_t quadIt = firstQuad; quadIt < endQuad; ++quadIt)
+	{
+		const uint32_t baseVertex = quadIt * 4;
+		outIndices.push_back(baseVertex + 0);
+		outIndices.push_back(baseVertex + 1);
+		outIndices.push_back(baseVertex + 2);
+		outIndices.push_back(baseVertex + 2);
+		outIndices.push_back(baseVertex + 1);
+		outIndices.push_back(baseVertex + 3);
+	}
+}
+
+static size_t getIndexSize(GLenum indexType)
+{
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Bytes to allocate for a buffer that has to hold size bytes. Storage that is big enough is kept, the first
+// allocation is exact and a buffer that outgrows it gets headroom so the next edits fit without reallocating
+static GLsizeiptr getBufferCapacity(GLsizeiptr capacity, size_t size)
+{
+	const GLsizeiptr requiredSize = static_cast<GLsizeiptr>(size);
+	if (requiredSize <= capacity)
+		return capacity;
+
+	return capacity < 0 ? requiredSize : requiredSize + requiredSize / 4;
+}
+
+// Writes into the existing storage of the buffer where it fits, otherwise reallocates it. The buffer name stays
+// the same either way so the vertex array and the shader storage bindings keep pointing at it
+static void writeBuffer(GLenum target, GLuint buffer, GLsizeiptr& capacity, const void* data, size_t size)
+{
+	glBindBuffer(target, buffer);
+
+	const GLsizeiptr newCapacity = getBufferCapacity(capacity, size);
+	if (newCapacity != capacity)
+	{
+		capacity = newCapacity;
+		glBufferData(target, capacity, static_cast<size_t>(capacity) == size ? data : nullptr, GL_STATIC_DRAW);
+		if (static_cast<size_t>(capacity) == size)
+			return;
+	}
+
+	if (size > 0)
+	{
+		glBufferSubData(target, 0, size, data);
+	}
+}
+
+static void writeIndices(GLenum target, GLuint buffer, GLsizeiptr& capacity, const std::vector<uint32_t>& indices, GLenum indexType)
+{
+	if (indexType == GL_UNSIGNED_SHORT)
+	{
+		std::vector<uint16_t> narrowIndices(indices.begin(), indices.end());
+		writeBuffer(target, buffer, capacity, narrowIndices.data(), narrowIndices.size() * sizeof(uint16_t));
+	}
+	else
+	{
+		writeBuffer(target, buffer, capacity, indices.data(), indices.size() * sizeof(uint32_t));
+	}
+}
+
+// The cull shader output needs room for every index of the chunk, its contents don't survive a remesh
+static void reserveCulledIndices(GLuint buffers[VisualChunk::FrameCount], GLsizeiptr& capacity, size_t size)
+{
+	const GLsizeiptr newCapacity = getBufferCapacity(capacity, size);
+	if (newCapacity == capacity)
+		return;
+
+	capacity = newCapacity;
+	for (uint32_t slot = 0; slot < VisualChunk::FrameCount; ++slot)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[slot]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+	}
 }
 
-void initVisualChunk(VisualChunk& visualChunk, const Chunk& chunk)
+// Quad corners of one section for every quad group, 4 vertices per quad
+struct SectionMesh
 {
-	std::vector<glm::vec3> positions;
-	std::vector<glm::vec2> texcoords;
-	std::vector<glm::vec3> normals;
-	std::vector<uint16_t> opaqueIndices;
-	std::vector<uint16_t> transparentIndices;
+	std::vector<glm::vec3> positions[QuadGroupCount];
+	std::vector<glm::vec3> normals[QuadGroupCount];
+	std::vector<uint32_t> lights[QuadGroupCount];
+};
 
+constexpr int32_t PaddedChunkSize = 18;
+constexpr size_t PaddedChunkVoxelCount = PaddedChunkSize * PaddedChunkSize * PaddedChunkSize;
+
+static_assert(ChunkWidth == 16 && ChunkHeight == 16 && ChunkDepth == 16, "Padded chunks are 16 voxels and a border on either side");
+
+// A chunk and the voxels of its 26 neighbours that touch it, copied out of the world so the mesher reads every
+// voxel it needs with fixed strides. Padded coordinates are the local coordinates of the chunk plus one.
+// Meshing reads nothing else, the copy is a consistent snapshot that could be meshed on another thread
+struct PaddedChunk
+{
+	// Occupancy of every run of 18 voxels along each axis, bit n is the voxel at padded coordinate n.
+	// solidX is indexed by z and y, solidY by z and x and solidZ by y and x
+	uint32_t solidX[PaddedChunkSize][PaddedChunkSize];
+	uint32_t solidY[PaddedChunkSize][PaddedChunkSize];
+	uint32_t solidZ[PaddedChunkSize][PaddedChunkSize];
+
+	// Sky light in the high and block light in the low 4 bits, x first, then y, then z
+	uint8_t light[PaddedChunkVoxelCount];
+
+	glm::vec3 chunkPos;
+	bool isEmpty;
+};
+
+static size_t getPaddedVoxelIndex(int32_t x, int32_t y, int32_t z)
+{
+	return static_cast<size_t>(x + PaddedChunkSize * (y + PaddedChunkSize * z));
+}
+
+// Copies the voxels of source in the box of local coordinates from min with size voxels along each axis, offset
+// by target to get padded coordinates. Without a source the voxels are empty and get full sky light, that chunk
+// is most likely still being generated
+static void copyPaddedVoxels(const Chunk* source, const glm::ivec3& min, const glm::ivec3& size, const glm::ivec3& target, PaddedChunk& outChunk)
+{
+	for (int32_t z = min.z; z < min.z + size.z; ++z)
+	{
+		for (int32_t y = min.y; y < min.y + size.y; ++y)
+		{
+			for (int32_t x = min.x; x < min.x + size.x; ++x)
+			{
+				const int32_t paddedX = x + target.x;
+				const int32_t paddedY = y + target.y;
+				const int32_t paddedZ = z + target.z;
+				uint8_t& light = outChunk.light[getPaddedVoxelIndex(paddedX, paddedY, paddedZ)];
+
+				if (!source)
+				{
+					light = MaxLightLevel << 4;
+					continue;
+				}
+
+				const size_t voxelIndex = getVoxelIndex(x, y, z);
+				light = static_cast<uint8_t>((getSkyLight(*source, voxelIndex) << 4) | getBlockLight(*source, voxelIndex));
+
+				if (isVoxelOccupied(source->occupancy, voxelIndex))
+				{
+					outChunk.solidX[paddedZ][paddedY] |= 1u << paddedX;
+					outChunk.solidY[paddedZ][paddedX] |= 1u << paddedY;
+					outChunk.solidZ[paddedY][paddedX] |= 1u << paddedZ;
+				}
+			}
+		}
+	}
+}
+
+// The runs of the chunk itself come straight from its occupancy copies, only the border is copied voxel by voxel
+static void gatherPaddedChunk(const World& world, const Chunk& chunk, PaddedChunk& outChunk)
+{
 	const int32_t chunkX = chunk.x * ChunkWidth;
 	const int32_t chunkY = chunk.y * ChunkHeight;
 	const int32_t chunkZ = chunk.z * ChunkDepth;
+	outChunk.chunkPos = glm::vec3(static_cast<float>(chunkX), static_cast<float>(chunkY), static_cast<float>(chunkZ));
+
+	// Nothing of an empty chunk is ever meshed
+	outChunk.isEmpty = chunk.occupancy.solidCount == 0;
+	if (outChunk.isEmpty)
+		return;
 
-	for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; ++voxelIt)
+	memset(outChunk.solidX, 0, sizeof(outChunk.solidX));
+	memset(outChunk.solidY, 0, sizeof(outChunk.solidY));
+	memset(outChunk.solidZ, 0, sizeof(outChunk.solidZ));
+
+	// Run n of every occupancy copy is 16 bits of word n / 4. It's the run at y n % 16 and z n / 16 for the x runs,
+	// at x n % 16 and z n / 16 for the y runs and at x n % 16 and y n / 16 for the z runs
+	const ChunkOccupancy& occupancy = chunk.occupancy;
+	for (size_t runIt = 0; runIt < ChunkVoxelCount / 16; ++runIt)
 	{
-		if (chunk.blocks[voxelIt] != 0)
+		const size_t shift = (runIt % 4) * 16;
+		const size_t across = runIt % 16 + 1;
+		const size_t layer = runIt / 16 + 1;
+		outChunk.solidX[layer][across] = static_cast<uint32_t>((occupancy.voxels[runIt / 4] >> shift) & 0xffff) << 1;
+		outChunk.solidY[layer][across] = static_cast<uint32_t>((occupancy.voxelsY[runIt / 4] >> shift) & 0xffff) << 1;
+		outChunk.solidZ[layer][across] = static_cast<uint32_t>((occupancy.voxelsZ[runIt / 4] >> shift) & 0xffff) << 1;
+	}
+
+	for (int32_t z = 0; z < static_cast<int32_t>(ChunkDepth); ++z)
+	{
+		for (int32_t y = 0; y < static_cast<int32_t>(ChunkHeight); ++y)
 		{
-			const int32_t voxelX = chunkX + (voxelIt % ChunkWidth);
-			const int32_t voxelY = chunkY + ((voxelIt / ChunkWidth) % ChunkHeight);
-			const int32_t voxelZ = chunkZ + ((voxelIt / ChunkWidth) / ChunkHeight);
-
-			const glm::vec3 pos(static_cast<float>(voxelX), static_cast<float>(voxelY), static_cast<float>(voxelZ));
-
-			uint16_t baseVertex;
-
-			bool isSemitransparent = false;
-
-			std::vector<uint16_t>& indices = isSemitransparent ? transparentIndices : opaqueIndices;
-
-			baseVertex = static_cast<uint16_t>(positions.size());
-			positions.push_back(pos + glm::vec3(0, 0, 0));
-			positions.push_back(pos + glm::vec3(1, 0, 0));
-			positions.push_back(pos + glm::vec3(0, 1, 0));
-			positions.push_back(pos + glm::vec3(1, 1, 0));
-			normals.push_back(glm::vec3(0, 0, 1));
-			normals.push_back(glm::vec3(0, 0, 1));
-			normals.push_back(glm::vec3(0, 0, 1));
-			normals.push_back(glm::vec3(0, 0, 1));
-			indices.push_back(baseVertex + 0);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 3);
-
-			baseVertex = static_cast<uint16_t>(positions.size());
-			positions.push_back(pos + glm::vec3(0, 0, 1));
-			positions.push_back(pos + glm::vec3(1, 0, 1));
-			positions.push_back(pos + glm::vec3(0, 1, 1));
-			positions.push_back(pos + glm::vec3(1, 1, 1));
-			normals.push_back(glm::vec3(0, 0, -1));
-			normals.push_back(glm::vec3(0, 0, -1));
-			normals.push_back(glm::vec3(0, 0, -1));
-			normals.push_back(glm::vec3(0, 0, -1));
-			indices.push_back(baseVertex + 0);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 3);
-
-			baseVertex = static_cast<uint16_t>(positions.size());
-			positions.push_back(pos + glm::vec3(0, 0, 0));
-			positions.push_back(pos + glm::vec3(1, 0, 0));
-			positions.push_back(pos + glm::vec3(0, 0, 1));
-			positions.push_back(pos + glm::vec3(1, 0, 1));
-			normals.push_back(glm::vec3(0, 1, 0));
-			normals.push_back(glm::vec3(0, 1, 0));
-			normals.push_back(glm::vec3(0, 1, 0));
-			normals.push_back(glm::vec3(0, 1, 0));
-			indices.push_back(baseVertex + 0);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 3);
-
-			baseVertex = static_cast<uint16_t>(positions.size());
-			positions.push_back(pos + glm::vec3(0, 1, 0));
-			positions.push_back(pos + glm::vec3(1, 1, 0));
-			positions.push_back(pos + glm::vec3(0, 1, 1));
-			positions.push_back(pos + glm::vec3(1, 1, 1));
-			normals.push_back(glm::vec3(0, -1, 0));
-			normals.push_back(glm::vec3(0, -1, 0));
-			normals.push_back(glm::vec3(0, -1, 0));
-			normals.push_back(glm::vec3(0, -1, 0));
-			indices.push_back(baseVertex + 0);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 3);
-
-			baseVertex = static_cast<uint16_t>(positions.size());
-			positions.push_back(pos + glm::vec3(0, 0, 0));
-			positions.push_back(pos + glm::vec3(0, 1, 0));
-			positions.push_back(pos + glm::vec3(0, 0, 1));
-			positions.push_back(pos + glm::vec3(0, 1, 1));
-			normals.push_back(glm::vec3(1, 0, 0));
-			normals.push_back(glm::vec3(1, 0, 0));
-			normals.push_back(glm::vec3(1, 0, 0));
-			normals.push_back(glm::vec3(1, 0, 0));
-			indices.push_back(baseVertex + 0);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 3);
-
-			baseVertex = static_cast<uint16_t>(positions.size());
-			positions.push_back(pos + glm::vec3(1, 0, 0));
-			positions.push_back(pos + glm::vec3(1, 1, 0));
-			positions.push_back(pos + glm::vec3(1, 0, 1));
-			positions.push_back(pos + glm::vec3(1, 1, 1));
-			normals.push_back(glm::vec3(-1, 0, 0));
-			normals.push_back(glm::vec3(-1, 0, 0));
-			normals.push_back(glm::vec3(-1, 0, 0));
-			normals.push_back(glm::vec3(-1, 0, 0));
-			indices.push_back(baseVertex + 0);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 2);
-			indices.push_back(baseVertex + 1);
-			indices.push_back(baseVertex + 3);
+			uint8_t* dst = outChunk.light + getPaddedVoxelIndex(1, y + 1, z + 1);
+			const size_t rowIndex = getVoxelIndex(0, y, z);
+			for (size_t x = 0; x < ChunkWidth; ++x)
+			{
+				dst[x] = static_cast<uint8_t>((getSkyLight(chunk, rowIndex + x) << 4) | getBlockLight(chunk, rowIndex + x));
+			}
 		}
 	}
 
-	visualChunk.opaqueIndexCount = static_cast<GLsizei>(opaqueIndices.size());
-	visualChunk.transparentIndexCount = static_cast<GLsizei>(transparentIndices.size());
+	// Along each axis a neighbour before the chunk gives its last layer, one after it its first
+	for (int32_t z = -1; z <= 1; ++z)
+	{
+		for (int32_t y = -1; y <= 1; ++y)
+		{
+			for (int32_t x = -1; x <= 1; ++x)
+			{
+				if (x == 0 && y == 0 && z == 0)
+					continue;
+
+				const Chunk* neighbour = findChunk(world, { chunk.x + x, chunk.y + y, chunk.z + z });
+				if (neighbour && !neighbour->isComplete)
+					neighbour = nullptr;
+
+				const glm::ivec3 offset(x, y, z);
+				glm::ivec3 min, size, target;
+				for (int32_t axis = 0; axis < 3; ++axis)
+				{
+					min[axis] = offset[axis] < 0 ? 15 : 0;
+					size[axis] = offset[axis] == 0 ? 16 : 1;
+					target[axis] = offset[axis] * 16 + 1;
+				}
+
+				copyPaddedVoxels(neighbour, min, size, target, outChunk);
+			}
+		}
+	}
+}
+
+// What the mesher reads of the voxels around a face
+struct MeshVoxel
+{
+	bool isSolid;
+	uint8_t skyLight;
+	uint8_t blockLight;
+};
+
+static MeshVoxel getMeshVoxel(const PaddedChunk& chunk, const glm::ivec3& paddedPos)
+{
+	const uint8_t light = chunk.light[getPaddedVoxelIndex(paddedPos.x, paddedPos.y, paddedPos.z)];
+	const bool isSolid = (chunk.solidX[paddedPos.z][paddedPos.y] >> paddedPos.x) & 1;
+	return { isSolid, static_cast<uint8_t>(light >> 4), static_cast<uint8_t>(light & 0xf) };
+}
+
+// Averaged sky and block light and the ambient occlusion of a corner as normalized bytes, chunk.vs reads them
+// as the x, y and z of a vec4. Occlusion goes from 0 for a corner in a crevice to 3 for an open one
+static uint32_t packVertexLight(uint32_t skyLightSum, uint32_t blockLightSum, uint32_t lightCount, uint32_t occlusion)
+{
+	constexpr uint32_t LevelScale = 255 / MaxLightLevel;
+	const uint32_t skyLight = (skyLightSum * LevelScale + lightCount / 2) / lightCount;
+	const uint32_t blockLight = (blockLightSum * LevelScale + lightCount / 2) / lightCount;
+	return skyLight | (blockLight << 8) | ((occlusion * 85) << 16);
+}
+
+// Light of the 4 corners of the face of the voxel at padded coordinates, from the 3x3 voxels of the layer in front
+// of it. Every corner is darkened by the solid voxels along its two edges and across from it, and averages the
+// light of the empty ones with the voxel right in front of the face. Returns whether the quad has to be flipped
+static bool getFaceCornerLights(const PaddedChunk& chunk, const glm::ivec3& paddedPos, FaceDirection direction, uint32_t outCornerLights[4])
+{
+	const glm::ivec3 front = paddedPos + getFaceNormal(direction);
+	const int32_t normalAxis = 2 - direction / 2;
+	const int32_t axisU = (normalAxis + 1) % 3;
+	const int32_t axisV = (normalAxis + 2) % 3;
+
+	MeshVoxel layer[3][3];
+	for (int32_t v = 0; v < 3; ++v)
+	{
+		for (int32_t u = 0; u < 3; ++u)
+		{
+			glm::ivec3 pos = front;
+			pos[axisU] += u - 1;
+			pos[axisV] += v - 1;
+			layer[v][u] = getMeshVoxel(chunk, pos);
+		}
+	}
+
+	const MeshVoxel& center = layer[1][1];
+	const FaceDesc& face = g_faceDescs[direction];
+	uint32_t occlusions[4];
+
+	for (uint32_t cornerIt = 0; cornerIt < 4; ++cornerIt)
+	{
+		const int32_t u = face.corners[cornerIt][axisU] > 0.0f ? 2 : 0;
+		const int32_t v = face.corners[cornerIt][axisV] > 0.0f ? 2 : 0;
+		const MeshVoxel& sideU = layer[1][u];
+		const MeshVoxel& sideV = layer[v][1];
+		const MeshVoxel& diagonal = layer[v][u];
+
+		// Light doesn't get through to the diagonal voxel between two solid ones
+		const bool isCornerHidden = sideU.isSolid && sideV.isSolid;
+		occlusions[cornerIt] = isCornerHidden ? 0 : 3 - sideU.isSolid - sideV.isSolid - diagonal.isSolid;
+
+		const MeshVoxel* lightVoxels[3] = { &sideU, &sideV, isCornerHidden ? nullptr : &diagonal };
+		uint32_t skyLightSum = center.skyLight;
+		uint32_t blockLightSum = center.blockLight;
+		uint32_t lightCount = 1;
+		for (const MeshVoxel* voxel : lightVoxels)
+		{
+			if (!voxel || voxel->isSolid)
+				continue;
+
+			skyLightSum += voxel->skyLight;
+			blockLightSum += voxel->blockLight;
+			++lightCount;
+		}
+
+		outCornerLights[cornerIt] = packVertexLight(skyLightSum, blockLightSum, lightCount, occlusions[cornerIt]);
+	}
+
+	// Interpolating across the diagonal through an occluded corner streaks its shadow over the whole quad,
+	// the diagonal goes between the two brighter corners instead
+	return occlusions[0] + occlusions[3] > occlusions[1] + occlusions[2];
+}
+
+// Solid voxels of a padded run whose neighbour towards the start or towards the end of the run is empty, bit 0 is
+// the first voxel of the chunk. Voxels on the chunk border are compared with the neighbouring chunk's
+static uint32_t getExposedTowardsStart(uint32_t solid)
+{
+	return ((solid & ~(solid << 1)) >> 1) & 0xffff;
+}
+
+static uint32_t getExposedTowardsEnd(uint32_t solid)
+{
+	return ((solid & ~(solid >> 1)) >> 1) & 0xffff;
+}
+
+// Adds a face for every set bit of exposed, bit n is the voxel n along runAxis from the first voxel of the run at
+// local coordinates runStart
+static void addExposedFaces(uint32_t exposed, const glm::ivec3& runStart, uint32_t runAxis, FaceDirection direction, const PaddedChunk& chunk, SectionMesh& outMesh)
+{
+	const uint32_t group = static_cast<uint32_t>(direction);
+
+	for (; exposed != 0; exposed &= exposed - 1)
+	{
+		glm::ivec3 local = runStart;
+		local[runAxis] += __builtin_ctz(exposed);
+
+		uint32_t cornerLights[4];
+		const bool isFlipped = getFaceCornerLights(chunk, local + glm::ivec3(1), direction, cornerLights);
+		addFace(direction, chunk.chunkPos + glm::vec3(local), cornerLights, isFlipped, outMesh.positions[group], outMesh.normals[group], outMesh.lights[group]);
+	}
+}
+
+// Faces between two solid blocks can never be seen. Every direction is culled with shifts of the padded runs along
+// its axis, 16 voxels at a time, and only the exposed voxels are visited
+static void meshSection(const PaddedChunk& chunk, uint32_t section, SectionMesh& outMesh)
+{
+	for (uint32_t group = 0; group < QuadGroupCount; ++group)
+	{
+		outMesh.positions[group].clear();
+		outMesh.normals[group].clear();
+		outMesh.lights[group].clear();
+	}
+
+	if (chunk.isEmpty)
+		return;
+
+	// The x and y runs of a section are the ones in its z layers, the z runs cross all sections
+	const int32_t firstZ = static_cast<int32_t>(section * ChunkSectionDepth);
+	const int32_t endZ = firstZ + static_cast<int32_t>(ChunkSectionDepth);
+	for (int32_t z = firstZ; z < endZ; ++z)
+	{
+		for (int32_t across = 0; across < 16; ++across)
+		{
+			const uint32_t solidX = chunk.solidX[z + 1][across + 1];
+			addExposedFaces(getExposedTowardsStart(solidX), glm::ivec3(0, across, z), 0, FaceNegX, chunk, outMesh);
+			addExposedFaces(getExposedTowardsEnd(solidX), glm::ivec3(0, across, z), 0, FacePosX, chunk, outMesh);
+
+			const uint32_t solidY = chunk.solidY[z + 1][across + 1];
+			addExposedFaces(getExposedTowardsStart(solidY), glm::ivec3(across, 0, z), 1, FaceNegY, chunk, outMesh);
+			addExposedFaces(getExposedTowardsEnd(solidY), glm::ivec3(across, 0, z), 1, FacePosY, chunk, outMesh);
+		}
+	}
+
+	const uint32_t sectionMask = ((1u << ChunkSectionDepth) - 1) << firstZ;
+	for (int32_t y = 0; y < 16; ++y)
+	{
+		for (int32_t x = 0; x < 16; ++x)
+		{
+			const uint32_t solidZ = chunk.solidZ[y + 1][x + 1];
+			addExposedFaces(getExposedTowardsStart(solidZ) & sectionMask, glm::ivec3(x, y, 0), 2, FaceNegZ, chunk, outMesh);
+			addExposedFaces(getExposedTowardsEnd(solidZ) & sectionMask, glm::ivec3(x, y, 0), 2, FacePosZ, chunk, outMesh);
+		}
+	}
+}
+
+static uint32_t getBucketQuadCapacity(const VisualChunk& visualChunk, uint32_t bucket)
+{
+	return visualChunk.bucketFirstQuads[bucket + 1] - visualChunk.bucketFirstQuads[bucket];
+}
+
+// Whole clusters of quad slots, so no cluster spans two buckets
+static uint32_t getQuadCapacity(uint32_t quadCount, bool hasHeadroom)
+{
+	const uint32_t capacity = hasHeadroom ? quadCount + quadCount / 4 : quadCount;
+	return (capacity + ClusterQuadCount - 1) / ClusterQuadCount * ClusterQuadCount;
+}
+
+// Lays out the quad slots of every bucket and uploads the whole mesh. The layout gets headroom
+// after a section outgrew its buckets, so the next edits of the chunk can patch it in place again
+static void uploadChunkMesh(VisualChunk& visualChunk, const SectionMesh sections[ChunkSectionCount], bool hasHeadroom)
+{
+	uint32_t quadCapacity = 0;
+	for (uint32_t group = 0; group < QuadGroupCount; ++group)
+	{
+		for (uint32_t section = 0; section < ChunkSectionCount; ++section)
+		{
+			const uint32_t bucket = getQuadBucket(group, section);
+			const uint32_t quadCount = static_cast<uint32_t>(sections[section].positions[group].size() / 4);
+
+			visualChunk.bucketFirstQuads[bucket] = quadCapacity;
+			visualChunk.bucketQuadCounts[bucket] = quadCount;
+			quadCapacity += getQuadCapacity(quadCount, hasHeadroom);
+		}
+	}
+	visualChunk.bucketFirstQuads[ChunkQuadBucketCount] = quadCapacity;
+
+	const uint32_t opaqueQuadCapacity = visualChunk.bucketFirstQuads[getQuadBucket(TransparentQuadGroup, 0)];
+
+	// 16-bit indices halve the index traffic of the cull shader and the draws, dense chunks that
+	// would wrap them fall back to 32-bit indices. cull.cs handles both
+	visualChunk.indexType = quadCapacity * 4 <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	const size_t indexSize = getIndexSize(visualChunk.indexType);
+
+	std::vector<glm::vec3> positions(quadCapacity * 4, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(quadCapacity * 4, glm::vec3(0.0f));
+	std::vector<uint32_t> lights(quadCapacity * 4, 0);
+	std::vector<QuadCluster> clusters(opaqueQuadCapacity / ClusterQuadCount);
+	for (uint32_t group = 0; group < QuadGroupCount; ++group)
+	{
+		for (uint32_t section = 0; section < ChunkSectionCount; ++section)
+		{
+			const uint32_t bucket = getQuadBucket(group, section);
+			const uint32_t firstQuad = visualChunk.bucketFirstQuads[bucket];
+			const SectionMesh& mesh = sections[section];
+
+			std::copy(mesh.positions[group].begin(), mesh.positions[group].end(), positions.begin() + firstQuad * 4);
+			std::copy(mesh.normals[group].begin(), mesh.normals[group].end(), normals.begin() + firstQuad * 4);
+			std::copy(mesh.lights[group].begin(), mesh.lights[group].end(), lights.begin() + firstQuad * 4);
+
+			if (group != TransparentQuadGroup)
+			{
+				const uint32_t clusterCount = getBucketQuadCapacity(visualChunk, bucket) / ClusterQuadCount;
+				buildClusters(static_cast<FaceDirection>(group), firstQuad, mesh.positions[group], clusterCount, clusters.data() + firstQuad / ClusterQuadCount);
+			}
+		}
+	}
+
+	std::vector<uint32_t> opaqueIndices;
+	std::vector<uint32_t> transparentIndices;
+	buildQuadIndices(0, opaqueQuadCapacity, opaqueIndices);
+	buildQuadIndices(opaqueQuadCapacity, quadCapacity, transparentIndices);
+
+	writeBuffer(GL_ARRAY_BUFFER, visualChunk.positionBuffer, visualChunk.positionCapacity, positions.data(), positions.size() * sizeof(glm::vec3));
+	writeBuffer(GL_ARRAY_BUFFER, visualChunk.texcoordBuffer, visualChunk.texcoordCapacity, nullptr, 0);
+	writeBuffer(GL_ARRAY_BUFFER, visualChunk.normalBuffer, visualChunk.normalCapacity, normals.data(), normals.size() * sizeof(glm::vec3));
+	writeBuffer(GL_ARRAY_BUFFER, visualChunk.lightBuffer, visualChunk.lightCapacity, lights.data(), lights.size() * sizeof(uint32_t));
+	writeBuffer(GL_SHADER_STORAGE_BUFFER, visualChunk.clusterBuffer, visualChunk.clusterCapacity, clusters.data(), clusters.size() * sizeof(QuadCluster));
+
+	writeIndices(GL_ELEMENT_ARRAY_BUFFER, visualChunk.opaqueIndexBuffer, visualChunk.opaqueIndexCapacity, opaqueIndices, visualChunk.indexType);
+	reserveCulledIndices(visualChunk.culledOpaqueIndexBuffers, visualChunk.culledOpaqueIndexCapacity, opaqueIndices.size() * indexSize);
+
+	writeIndices(GL_ELEMENT_ARRAY_BUFFER, visualChunk.transparentIndexBuffer, visualChunk.transparentIndexCapacity, transparentIndices, visualChunk.indexType);
+	reserveCulledIndices(visualChunk.culledTransparentIndexBuffers, visualChunk.culledTransparentIndexCapacity, transparentIndices.size() * indexSize);
+}
+
+// Rewrites the quad and cluster slots of the buckets of one section. The indices only depend on the
+// slots and stay as they are, the slots past the new quads keep stale vertices no range refers to
+static void patchSectionMesh(VisualChunk& visualChunk, uint32_t section, const SectionMesh& mesh)
+{
+	for (uint32_t group = 0; group < QuadGroupCount; ++group)
+	{
+		const uint32_t bucket = getQuadBucket(group, section);
+		const uint32_t firstQuad = visualChunk.bucketFirstQuads[bucket];
+		const size_t vertexCount = mesh.positions[group].size();
+
+		visualChunk.bucketQuadCounts[bucket] = static_cast<uint32_t>(vertexCount / 4);
+
+		if (vertexCount > 0)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, visualChunk.positionBuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, firstQuad * 4 * sizeof(glm::vec3), vertexCount * sizeof(glm::vec3), mesh.positions[group].data());
+			glBindBuffer(GL_ARRAY_BUFFER, visualChunk.normalBuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, firstQuad * 4 * sizeof(glm::vec3), vertexCount * sizeof(glm::vec3), mesh.normals[group].data());
+			glBindBuffer(GL_ARRAY_BUFFER, visualChunk.lightBuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, firstQuad * 4 * sizeof(uint32_t), vertexCount * sizeof(uint32_t), mesh.lights[group].data());
+		}
+
+		const uint32_t clusterCount = getBucketQuadCapacity(visualChunk, bucket) / ClusterQuadCount;
+		if (group != TransparentQuadGroup && clusterCount > 0)
+		{
+			std::vector<QuadCluster> clusters(clusterCount);
+			buildClusters(static_cast<FaceDirection>(group), firstQuad, mesh.positions[group], clusterCount, clusters.data());
+
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, visualChunk.clusterBuffer);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, firstQuad / ClusterQuadCount * sizeof(QuadCluster), clusterCount * sizeof(QuadCluster), clusters.data());
+		}
+	}
+}
+
+void initVisualChunk(VisualChunk& visualChunk, const World& world, const Chunk& chunk)
+{
+	PaddedChunk paddedChunk;
+	gatherPaddedChunk(world, chunk, paddedChunk);
+
+	SectionMesh sections[ChunkSectionCount];
+	for (uint32_t section = 0; section < ChunkSectionCount; ++section)
+	{
+		meshSection(paddedChunk, section, sections[section]);
+	}
 
 	glGenVertexArrays(1, &visualChunk.vertexArray);
 	glBindVertexArray(visualChunk.vertexArray);
 
 	glGenBuffers(1, &visualChunk.positionBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, visualChunk.positionBuffer);
-	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 	glEnableVertexAttribArray(0);
 
 	glGenBuffers(1, &visualChunk.texcoordBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, visualChunk.texcoordBuffer);
-	glBufferData(GL_ARRAY_BUFFER, texcoords.size() * sizeof(glm::vec2), texcoords.data(), GL_STATIC_DRAW);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
 	glEnableVertexAttribArray(1);
 
 	glGenBuffers(1, &visualChunk.normalBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, visualChunk.normalBuffer);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 	glEnableVertexAttribArray(2);
 
-	// Opaque index buffers
-	glGenBuffers(1, &visualChunk.opaqueIndexBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, visualChunk.opaqueIndexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, opaqueIndices.size() * sizeof(uint16_t), opaqueIndices.data(), GL_STATIC_DRAW);
-	glGenBuffers(1, &visualChunk.culledOpaqueIndexBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, visualChunk.culledOpaqueIndexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, opaqueIndices.size() * sizeof(uint16_t), nullptr, GL_DYNAMIC_DRAW);
+	glGenBuffers(1, &visualChunk.lightBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, visualChunk.lightBuffer);
+	glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, nullptr);
+	glEnableVertexAttribArray(3);
 
-	// Transparent index buffers
+	glGenBuffers(1, &visualChunk.clusterBuffer);
+	glGenBuffers(1, &visualChunk.opaqueIndexBuffer);
+	glGenBuffers(VisualChunk::FrameCount, visualChunk.culledOpaqueIndexBuffers);
+	glGenBuffers(VisualChunk::FrameCount, visualChunk.opaqueDrawArgs);
 	glGenBuffers(1, &visualChunk.transparentIndexBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, visualChunk.transparentIndexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, transparentIndices.size() * sizeof(uint16_t), transparentIndices.data(), GL_STATIC_DRAW);
-	glGenBuffers(1, &visualChunk.culledTransparentIndexBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, visualChunk.culledTransparentIndexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, transparentIndices.size() * sizeof(uint16_t), nullptr, GL_DYNAMIC_DRAW);
+	glGenBuffers(VisualChunk::FrameCount, visualChunk.culledTransparentIndexBuffers);
+	glGenBuffers(VisualChunk::FrameCount, visualChunk.transparentDrawArgs);
 
-	struct alignas(64) DrawElementsIndirectCommand
+	// Nothing is allocated yet, the first upload sizes every buffer exactly
+	visualChunk.positionCapacity = -1;
+	visualChunk.texcoordCapacity = -1;
+	visualChunk.normalCapacity = -1;
+	visualChunk.lightCapacity = -1;
+	visualChunk.clusterCapacity = -1;
+	visualChunk.opaqueIndexCapacity = -1;
+	visualChunk.culledOpaqueIndexCapacity = -1;
+	visualChunk.transparentIndexCapacity = -1;
+	visualChunk.culledTransparentIndexCapacity = -1;
+
+	uploadChunkMesh(visualChunk, sections, false);
+
+	const int32_t chunkX = chunk.x * ChunkWidth;
+	const int32_t chunkY = chunk.y * ChunkHeight;
+	const int32_t chunkZ = chunk.z * ChunkDepth;
+
+	visualChunk.boundsMin = glm::vec3(static_cast<float>(chunkX), static_cast<float>(chunkY), static_cast<float>(chunkZ));
+	visualChunk.boundsMax = visualChunk.boundsMin + glm::vec3(static_cast<float>(ChunkWidth), static_cast<float>(ChunkHeight), static_cast<float>(ChunkDepth));
+
+	for (uint64_t& lastUsedFrame : visualChunk.slotLastUsedFrame)
 	{
-        uint count;
-        uint primCount;
-        uint firstIndex;
-        uint baseVertex;
-        uint baseInstance;
-    };
+		lastUsedFrame = 0;
+	}
+	visualChunk.culledSlot = 0;
+	visualChunk.culledFrustumState = FrustumOutside;
+	visualChunk.culledCameraCellMin = glm::ivec3(0);
+	visualChunk.culledCameraCellMax = glm::ivec3(0);
+	visualChunk.visibleFaceMask = 0;
+	visualChunk.hasCullResults = false;
+	visualChunk.isVisible = false;
+	visualChunk.wasVisible = false;
 
-	// Indirect arg buffers
-	glGenBuffers(1, &visualChunk.opaqueDrawArgs);
-	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visualChunk.opaqueDrawArgs);
-	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+	const DrawElementsIndirectCommand initialDrawArgs = { 0, 1, 0, 0, 0 };
+	for (uint32_t slot = 0; slot < VisualChunk::FrameCount; ++slot)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visualChunk.opaqueDrawArgs[slot]);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), &initialDrawArgs, GL_DYNAMIC_DRAW);
 
-	glGenBuffers(1, &visualChunk.transparentDrawArgs);
-	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visualChunk.transparentDrawArgs);
-	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visualChunk.transparentDrawArgs[slot]);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), &initialDrawArgs, GL_DYNAMIC_DRAW);
+	}
 }
 
-void cullChunk(const VisualChunk& chunk, const CullChunkParams& params)
+void updateVisualChunk(VisualChunk& visualChunk, const World& world, const Chunk& chunk, uint32_t sectionMask)
 {
-	if (VisualChunk::s_triangleFilteringEnabled && !VisualChunk::s_freezeCulling)
+	PaddedChunk paddedChunk;
+	gatherPaddedChunk(world, chunk, paddedChunk);
+
+	SectionMesh sections[ChunkSectionCount];
+
+	bool isInPlace = true;
+	for (uint32_t section = 0; section < ChunkSectionCount; ++section)
+	{
+		if ((sectionMask & (1u << section)) == 0)
+			continue;
+
+		meshSection(paddedChunk, section, sections[section]);
+		for (uint32_t group = 0; group < QuadGroupCount; ++group)
+		{
+			if (sections[section].positions[group].size() / 4 > getBucketQuadCapacity(visualChunk, getQuadBucket(group, section)))
+				isInPlace = false;
+		}
+	}
+
+	if (isInPlace)
+	{
+		for (uint32_t section = 0; section < ChunkSectionCount; ++section)
+		{
+			if (sectionMask & (1u << section))
+				patchSectionMesh(visualChunk, section, sections[section]);
+		}
+	}
+	else
 	{
-		glUseProgram(g_cullShaderProgram);
+		// A section outgrew its slots, the whole chunk is laid out again
+		for (uint32_t section = 0; section < ChunkSectionCount; ++section)
+		{
+			if ((sectionMask & (1u << section)) == 0)
+				meshSection(paddedChunk, section, sections[section]);
+		}
+		uploadChunkMesh(visualChunk, sections, true);
+	}
+
+	// The culled indices of every slot refer to the old vertices. Culling runs again before the next
+	// filtered draw, until then (or while culling is frozen) the chunk draws nothing
+	const GLuint zero = 0;
+	for (uint32_t slot = 0; slot < VisualChunk::FrameCount; ++slot)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visualChunk.opaqueDrawArgs[slot]);
+		glClearBufferSubData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	}
+	visualChunk.hasCullResults = false;
+}
 
-		GLuint triangleCount = chunk.opaqueIndexCount / 3;
-		GLuint quadCount = triangleCount / 2;
+static void extractFrustumPlanes(const glm::mat4& m, glm::vec4 outPlanes[6])
+{
+	// Gribb/Hartmann, rows of the view projection matrix combined with the w row
+	const glm::vec4 rowX(m[0][0], m[1][0], m[2][0], m[3][0]);
+	const glm::vec4 rowY(m[0][1], m[1][1], m[2][1], m[3][1]);
+	const glm::vec4 rowZ(m[0][2], m[1][2], m[2][2], m[3][2]);
+	const glm::vec4 rowW(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	outPlanes[0] = rowW + rowX;
+	outPlanes[1] = rowW - rowX;
+	outPlanes[2] = rowW + rowY;
+	outPlanes[3] = rowW - rowY;
+	outPlanes[4] = rowW + rowZ;
+	outPlanes[5] = rowW - rowZ;
+}
 
-		glUniform1ui(0, quadCount);
-		glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(params.matViewProj));
+static FrustumState testFrustum(const glm::vec4 planes[6], const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	FrustumState state = FrustumInside;
+
+	for (int32_t planeIt = 0; planeIt < 6; ++planeIt)
+	{
+		const glm::vec4& plane = planes[planeIt];
 
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, chunk.opaqueIndexBuffer);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, chunk.culledOpaqueIndexBuffer);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, chunk.positionBuffer);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, chunk.opaqueDrawArgs);
+		// The corner furthest along the plane normal decides if the box is outside,
+		// the one furthest against it decides if the box is fully inside
+		const glm::vec3 farCorner(plane.x > 0.0f ? boundsMax.x : boundsMin.x, plane.y > 0.0f ? boundsMax.y : boundsMin.y, plane.z > 0.0f ? boundsMax.z : boundsMin.z);
+		const glm::vec3 nearCorner(plane.x > 0.0f ? boundsMin.x : boundsMax.x, plane.y > 0.0f ? boundsMin.y : boundsMax.y, plane.z > 0.0f ? boundsMin.z : boundsMax.z);
 
-		GLuint threadGroupSize = 64;
-		GLuint threadCount = quadCount;
-		GLuint threadGroupCount = (threadCount + threadGroupSize - 1) / threadGroupSize;
-		glDispatchCompute(threadGroupCount, 1, 1);
+		if (plane.x * farCorner.x + plane.y * farCorner.y + plane.z * farCorner.z + plane.w < 0.0f)
+			return FrustumOutside;
+
+		if (plane.x * nearCorner.x + plane.y * nearCorner.y + plane.z * nearCorner.z + plane.w < 0.0f)
+			state = FrustumIntersecting;
 	}
+
+	return state;
+}
+
+// Mask of the face directions that can face the camera. Faces pointing towards -axis lie on the planes
+// boundsMin..boundsMax - 1 and are only visible from below the furthest one, +axis faces the other way around
+static uint8_t getVisibleFaceMask(const glm::vec3& cameraPos, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	static const int32_t faceAxes[FaceDirectionCount] = { 2, 2, 1, 1, 0, 0 };
+
+	uint8_t mask = 0;
+	for (int32_t direction = 0; direction < FaceDirectionCount; ++direction)
+	{
+		const int32_t axis = faceAxes[direction];
+		const bool isPositive = (direction & 1) != 0;
+
+		const bool isVisible = isPositive ? cameraPos[axis] > boundsMin[axis] + 1.0f : cameraPos[axis] < boundsMax[axis] - 1.0f;
+		if (isVisible)
+			mask |= 1 << direction;
+	}
+	return mask;
+}
+
+// The cluster backface tests compare the camera against faces on integer planes within the chunk bounds,
+// their results can only change when the camera crosses one of those planes. The floor and ceiling of
+// the camera position clamped to just outside the bounds identify the cell between them.
+static void getCameraCell(const glm::vec3& cameraPos, const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::ivec3& outCellMin, glm::ivec3& outCellMax)
+{
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		const float clamped = std::min(std::max(cameraPos[axis], boundsMin[axis] - 0.5f), boundsMax[axis] + 0.5f);
+		outCellMin[axis] = static_cast<int32_t>(floorf(clamped));
+		outCellMax[axis] = static_cast<int32_t>(ceilf(clamped));
+	}
+}
+
+// Appends the range (first, count) to the rangeCount ranges in outRanges, merged with the last one when
+// they are adjacent. Returns the new number of ranges
+static uint32_t addRange(uint32_t first, uint32_t count, uint32_t rangeCount, uint32_t outRanges[][2])
+{
+	if (count == 0)
+		return rangeCount;
+
+	if (rangeCount > 0 && outRanges[rangeCount - 1][0] + outRanges[rangeCount - 1][1] == first)
+	{
+		outRanges[rangeCount - 1][1] += count;
+		return rangeCount;
+	}
+
+	outRanges[rangeCount][0] = first;
+	outRanges[rangeCount][1] = count;
+	return rangeCount + 1;
+}
+
+// Quad ranges of the buckets of the groups in the mask as (first quad, quad count). Returns the number of ranges
+static uint32_t getQuadRanges(const VisualChunk& chunk, uint32_t groupMask, uint32_t outRanges[ChunkQuadBucketCount][2])
+{
+	uint32_t rangeCount = 0;
+	for (uint32_t group = 0; group < QuadGroupCount; ++group)
+	{
+		if ((groupMask & (1u << group)) == 0)
+			continue;
+
+		for (uint32_t section = 0; section < ChunkSectionCount; ++section)
+		{
+			const uint32_t bucket = getQuadBucket(group, section);
+			rangeCount = addRange(chunk.bucketFirstQuads[bucket], chunk.bucketQuadCounts[bucket], rangeCount, outRanges);
+		}
+	}
+	return rangeCount;
+}
+
+// Cluster ranges of the face directions in the mask as (first cluster, cluster count). The empty
+// cluster slots of the buckets are included, the cull shader skips them. Returns the number of ranges
+static uint32_t getClusterRanges(const VisualChunk& chunk, uint8_t faceMask, uint32_t outRanges[FaceDirectionCount][2])
+{
+	uint32_t rangeCount = 0;
+	for (uint32_t direction = 0; direction < FaceDirectionCount; ++direction)
+	{
+		if ((faceMask & (1u << direction)) == 0)
+			continue;
+
+		const uint32_t firstQuad = chunk.bucketFirstQuads[getQuadBucket(direction, 0)];
+		const uint32_t endQuad = chunk.bucketFirstQuads[getQuadBucket(direction + 1, 0)];
+		rangeCount = addRange(firstQuad / ClusterQuadCount, (endQuad - firstQuad) / ClusterQuadCount, rangeCount, outRanges);
+	}
+	return rangeCount;
+}
+
+static bool isSameMatrix(const glm::mat4& a, const glm::mat4& b)
+{
+	return memcmp(&a, &b, sizeof(glm::mat4)) == 0;
+}
+
+static uint32_t findFreeCullSlot(const VisualChunk& chunk)
+{
+	// A slot is free once the last frame drawing from it has completed, at most FrameCount - 1
+	// frames are in flight so one of the slots we are not currently drawing from is always free
+	for (uint32_t slotIt = 1; slotIt <= VisualChunk::FrameCount; ++slotIt)
+	{
+		const uint32_t slot = (chunk.culledSlot + slotIt) % VisualChunk::FrameCount;
+		const uint64_t lastUsedFrame = chunk.slotLastUsedFrame[slot];
+		if (lastUsedFrame == 0 || lastUsedFrame - 1 + VisualChunk::FrameCount <= g_frameNumber)
+			return slot;
+	}
+
+	return (chunk.culledSlot + 1) % VisualChunk::FrameCount;
+}
+
+static void dispatchCullChunk(const VisualChunk& chunk, uint32_t slot, const glm::vec4 frustumPlanes[6], const CullChunkParams& params)
+{
+	glUseProgram(g_cullShaderProgram);
+
+	// Only the clusters of face buckets that can face the camera are culled, the rest never reach the draw
+	GLuint clusterRanges[FaceDirectionCount][2];
+	const GLuint rangeCount = getClusterRanges(chunk, chunk.visibleFaceMask, clusterRanges);
+
+	GLuint clusterCount = 0;
+	for (GLuint rangeIt = 0; rangeIt < rangeCount; ++rangeIt)
+	{
+		clusterCount += clusterRanges[rangeIt][1];
+	}
+
+	glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(params.matViewProj));
+	glUniform1ui(2, rangeCount);
+	glUniform2uiv(3, rangeCount, &clusterRanges[0][0]);
+	glUniform4fv(9, 6, glm::value_ptr(frustumPlanes[0]));
+	glUniform3fv(15, 1, glm::value_ptr(params.cameraPos));
+	glUniform1ui(16, chunk.indexType == GL_UNSIGNED_INT ? 1 : 0);
+
+	// Reset the index count before the dispatch, doing it from the first invocation
+	// of the shader races with the atomics of every other work group
+	const GLuint zero = 0;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, chunk.opaqueDrawArgs[slot]);
+	glClearBufferSubData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, chunk.opaqueIndexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, chunk.culledOpaqueIndexBuffers[slot]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, chunk.positionBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, chunk.opaqueDrawArgs[slot]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, chunk.clusterBuffer);
+
+	if (clusterCount > 0)
+	{
+		glDispatchCompute(clusterCount, 1, 1);
+	}
+}
+
+static void cullChunk(VisualChunk& chunk, const glm::vec4 frustumPlanes[6], const CullChunkParams& params, CullStats& stats)
+{
+	if (!VisualChunk::s_freezeCulling)
+	{
+		chunk.wasVisible = chunk.isVisible;
+
+		const FrustumState frustumState = testFrustum(frustumPlanes, chunk.boundsMin, chunk.boundsMax);
+		chunk.visibleFaceMask = getVisibleFaceMask(params.cameraPos, chunk.boundsMin, chunk.boundsMax);
+		chunk.isVisible = frustumState != FrustumOutside && chunk.visibleFaceMask != 0;
+
+		if (chunk.isVisible && VisualChunk::s_triangleFilteringEnabled)
+		{
+			glm::ivec3 cameraCellMin;
+			glm::ivec3 cameraCellMax;
+			getCameraCell(params.cameraPos, chunk.boundsMin, chunk.boundsMax, cameraCellMin, cameraCellMax);
+
+			// The frustum tests only depend on the view when the chunk straddles the frustum,
+			// a chunk that stays fully inside only needs the camera to stay in the same cell
+			bool canReuse = chunk.hasCullResults;
+			if (canReuse)
+			{
+				const bool stayedInside = frustumState == FrustumInside && chunk.culledFrustumState == FrustumInside &&
+					cameraCellMin == chunk.culledCameraCellMin && cameraCellMax == chunk.culledCameraCellMax;
+				canReuse = stayedInside || isSameMatrix(params.matViewProj, chunk.culledViewProj);
+			}
+
+			if (canReuse)
+			{
+				++stats.reusedChunks;
+			}
+			else
+			{
+				const uint32_t slot = findFreeCullSlot(chunk);
+				dispatchCullChunk(chunk, slot, frustumPlanes, params);
+
+				chunk.culledSlot = slot;
+				chunk.culledViewProj = params.matViewProj;
+				chunk.culledFrustumState = frustumState;
+				chunk.culledCameraCellMin = cameraCellMin;
+				chunk.culledCameraCellMax = cameraCellMax;
+				chunk.hasCullResults = true;
+				++stats.dispatchedChunks;
+			}
+		}
+	}
+
+	if (chunk.isVisible)
+	{
+		chunk.slotLastUsedFrame[chunk.culledSlot] = g_frameNumber + 1;
+		++stats.visibleChunks;
+	}
+}
+
+void cullChunks(std::vector<VisualChunk>& chunks, const CullChunkParams& params, std::vector<const VisualChunk*>& outDrawList, CullStats* outStats)
+{
+	glm::vec4 frustumPlanes[6];
+	extractFrustumPlanes(params.matViewProj, frustumPlanes);
+
+	CullStats stats = {};
+	for (VisualChunk& chunk : chunks)
+	{
+		cullChunk(chunk, frustumPlanes, params, stats);
+	}
+
+	// Chunks that were visible last frame are the most likely occluders, draw them first
+	outDrawList.clear();
+	for (const VisualChunk& chunk : chunks)
+	{
+		if (chunk.isVisible && chunk.wasVisible)
+			outDrawList.push_back(&chunk);
+	}
+	for (const VisualChunk& chunk : chunks)
+	{
+		if (chunk.isVisible && !chunk.wasVisible)
+			outDrawList.push_back(&chunk);
+	}
+
+	if (outStats)
+		*outStats = stats;
+}
+
+static void drawQuadRanges(const VisualChunk& chunk, GLuint indexBuffer, uint32_t firstBufferQuad, const GLuint quadRanges[][2], GLuint rangeCount)
+{
+	const size_t indexSize = getIndexSize(chunk.indexType);
+
+	GLsizei counts[ChunkQuadBucketCount];
+	const void* offsets[ChunkQuadBucketCount];
+	for (GLuint rangeIt = 0; rangeIt < rangeCount; ++rangeIt)
+	{
+		offsets[rangeIt] = reinterpret_cast<const void*>(static_cast<uintptr_t>(quadRanges[rangeIt][0] - firstBufferQuad) * 6 * indexSize);
+		counts[rangeIt] = static_cast<GLsizei>(quadRanges[rangeIt][1] * 6);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glMultiDrawElements(GL_TRIANGLES, counts, chunk.indexType, offsets, static_cast<GLsizei>(rangeCount));
 }
 
 void drawChunkOpaque(const VisualChunk& chunk)
@@ -268,14 +1118,16 @@ void drawChunkOpaque(const VisualChunk& chunk)
 
 	if (VisualChunk::s_triangleFilteringEnabled)
 	{
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.culledOpaqueIndexBuffer);
-		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, chunk.opaqueDrawArgs);
-		glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.culledOpaqueIndexBuffers[chunk.culledSlot]);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, chunk.opaqueDrawArgs[chunk.culledSlot]);
+		glDrawElementsIndirect(GL_TRIANGLES, chunk.indexType, nullptr);
 	}
 	else
 	{
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.opaqueIndexBuffer);
-		glDrawElements(GL_TRIANGLES, chunk.opaqueIndexCount, GL_UNSIGNED_SHORT, nullptr);
+		GLuint quadRanges[ChunkQuadBucketCount][2];
+		const GLuint rangeCount = getQuadRanges(chunk, chunk.visibleFaceMask, quadRanges);
+
+		drawQuadRanges(chunk, chunk.opaqueIndexBuffer, 0, quadRanges, rangeCount);
 	}
 }
 
@@ -283,6 +1135,9 @@ void drawChunkTransparent(const VisualChunk& chunk)
 {
 	glBindVertexArray(chunk.vertexArray);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.transparentIndexBuffer);
-	glDrawElements(GL_TRIANGLES, chunk.transparentIndexCount, GL_UNSIGNED_SHORT, nullptr);
+	GLuint quadRanges[ChunkQuadBucketCount][2];
+	const GLuint rangeCount = getQuadRanges(chunk, 1u << TransparentQuadGroup, quadRanges);
+
+	// The transparent index buffer starts at the first transparent quad slot
+	drawQuadRanges(chunk, chunk.transparentIndexBuffer, chunk.bucketFirstQuads[getQuadBucket(TransparentQuadGroup, 0)], quadRanges, rangeCount);
 }
\ No newline at end of file
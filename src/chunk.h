@@ -1,51 +1,253 @@
 #pragma once
 
+#include "blockstorage.h"
+
 #include <vector>
 
 #include <glad/glad.h>
+#include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 
+struct World;
+
+constexpr size_t ChunkWidth = 16;
+constexpr size_t ChunkHeight = 16;
+constexpr size_t ChunkDepth = 16;
+
+constexpr size_t ChunkVoxelCount = ChunkWidth * ChunkHeight * ChunkDepth;
+
+// Chunk meshes are split into sections of ChunkSectionDepth z layers, an edit only remeshes the sections around it
+constexpr size_t ChunkSectionDepth = 4;
+constexpr size_t ChunkSectionCount = ChunkDepth / ChunkSectionDepth;
+
+// Blocks are stored x first, then y, then z
+inline size_t getVoxelIndex(size_t x, size_t y, size_t z)
+{
+	return x + ChunkWidth * (y + ChunkHeight * z);
+}
+
+// Voxels are grouped in bricks of ChunkBrickSize cubed for coarse occupancy tests
+constexpr size_t ChunkBrickSize = 4;
+constexpr size_t ChunkBrickCount = ChunkVoxelCount / (ChunkBrickSize * ChunkBrickSize * ChunkBrickSize);
+
+// Solid voxels of a chunk as one bit per voxel in voxel index order, and one bit per brick that is set while
+// any of its voxels is solid. Built when the chunk completes and kept in sync with every edit, see occupancy.h
+struct ChunkOccupancy
+{
+	uint64_t voxels[ChunkVoxelCount / 64];
+
+	// The same bits transposed so that runs of 16 voxels along y and along z are contiguous
+	uint64_t voxelsY[ChunkVoxelCount / 64];
+	uint64_t voxelsZ[ChunkVoxelCount / 64];
+
+	uint64_t bricks;
+	uint32_t solidCount;
+};
+
+static_assert(ChunkBrickCount == 64, "Brick occupancy is a single word");
+
 struct Chunk
 {
 	int32_t x;
 	int32_t y;
 	int32_t z;
 
-	std::vector<uint32_t> blocks;
+	// Set on the main thread once generation is done with the chunk, only complete chunks can be edited
+	bool isComplete = false;
+
+	BlockStorage blocks;
+
+	// One bit per voxel changed since generation, empty while nothing was
+	std::vector<uint64_t> editMask;
+
+	// Only valid once the chunk is complete
+	ChunkOccupancy occupancy;
+
+	// 4 bit block and sky light levels of every voxel, two voxels per byte with the first in the low bits.
+	// Only valid once the chunk is complete, see light.h
+	uint8_t blockLight[ChunkVoxelCount / 2];
+	uint8_t skyLight[ChunkVoxelCount / 2];
+};
+
+// The part of a chunk a save reads. Taking one only shares the copy-on-write blocks and copies the edit mask
+struct ChunkSnapshot
+{
+	int32_t x;
+	int32_t y;
+	int32_t z;
+
+	BlockStorage blocks;
+	std::vector<uint64_t> editMask;
 };
 
+inline ChunkSnapshot getChunkSnapshot(const Chunk& chunk)
+{
+	return { chunk.x, chunk.y, chunk.z, chunk.blocks, chunk.editMask };
+}
+
+inline void markVoxelEdited(Chunk& chunk, size_t voxelIndex)
+{
+	if (chunk.editMask.empty())
+	{
+		chunk.editMask.resize(ChunkVoxelCount / 64);
+	}
+	chunk.editMask[voxelIndex / 64] |= uint64_t(1) << (voxelIndex % 64);
+}
+
+inline bool isVoxelEdited(const Chunk& chunk, size_t voxelIndex)
+{
+	return !chunk.editMask.empty() && (chunk.editMask[voxelIndex / 64] >> (voxelIndex % 64)) & 1;
+}
+
+// Column height of a column without any solid block
+constexpr int16_t EmptyColumnHeight = -1;
+
+struct ColumnInfo
+{
+	// World y of the highest solid block and that block
+	int16_t height;
+	uint16_t topBlock;
+};
+
+// Everything known about the ChunkWidth x ChunkDepth block columns of a stack of chunks, indexed [z][x].
+// The generation inputs are filled once before any chunk of the column is generated and only read
+// after that. The column info is kept up to date with the completed chunks and edits.
+struct ChunkColumn
+{
+	int32_t x;
+	int32_t z;
+
+	float terrainHeights[ChunkDepth][ChunkWidth];
+	float humidity[ChunkDepth][ChunkWidth];
+
+	ColumnInfo columns[ChunkDepth][ChunkWidth];
+};
+
+// Outward facing direction of a block face
+enum FaceDirection
+{
+	FaceNegZ,
+	FacePosZ,
+	FaceNegY,
+	FacePosY,
+	FaceNegX,
+	FacePosX,
+	FaceDirectionCount
+};
+
+// Outward facing normal of a face direction
+inline glm::ivec3 getFaceNormal(FaceDirection direction)
+{
+	static const glm::ivec3 normals[FaceDirectionCount] =
+	{
+		glm::ivec3(0, 0, -1),
+		glm::ivec3(0, 0, 1),
+		glm::ivec3(0, -1, 0),
+		glm::ivec3(0, 1, 0),
+		glm::ivec3(-1, 0, 0),
+		glm::ivec3(1, 0, 0),
+	};
+	return normals[direction];
+}
+
+// Quads are stored in buckets of one section and face direction, every section has one more for its transparent quads
+constexpr uint32_t ChunkQuadBucketCount = (FaceDirectionCount + 1) * ChunkSectionCount;
+
 struct VisualChunk
 {
+	// Number of frames the CPU may run ahead of the GPU. Every buffer written by
+	// the cull shader exists once per frame so that culling frame N never
+	// overwrites the buffers a still-executing draw from frame N-1 reads from.
+	static constexpr uint32_t FrameCount = 3;
+
 	static bool s_triangleFilteringEnabled;
 	static bool s_freezeCulling;
 
 	static void init();
 	static void deinit();
 
+	// Frame synchronisation, call in this order every frame:
+	// beginFrame() before culling, syncCulling() between culling and drawing
+	// and endFrame() after the last draw that reads culled buffers.
+	static void beginFrame();
+	static void syncCulling();
+	static void endFrame();
+
 	GLuint vertexArray;
 	GLuint positionBuffer;
 	GLuint texcoordBuffer;
 	GLuint normalBuffer;
+	GLuint lightBuffer;
+
+	// GL_UNSIGNED_SHORT unless the chunk has more vertex slots than 16-bit indices can address
+	GLenum indexType;
+
+	// Every bucket owns a fixed range of quad slots in whole clusters, ordered by face direction, then section,
+	// with the transparent buckets last. A remesh rewrites the slots of the sections that changed in place
+	// as long as their quads fit. Quads are 4 consecutive vertices so the index buffers never change
+	uint32_t bucketFirstQuads[ChunkQuadBucketCount + 1];
+	uint32_t bucketQuadCounts[ChunkQuadBucketCount];
 
 	GLuint opaqueIndexBuffer;
-	GLsizei opaqueIndexCount;
-	GLuint culledOpaqueIndexBuffer;
-	GLuint opaqueDrawArgs;
+	GLuint clusterBuffer;
+	GLuint culledOpaqueIndexBuffers[FrameCount];
+	GLuint opaqueDrawArgs[FrameCount];
 
 	GLuint transparentIndexBuffer;
-	GLsizei transparentIndexCount;
-	GLuint culledTransparentIndexBuffer;
-	GLuint transparentDrawArgs;
+	GLuint culledTransparentIndexBuffers[FrameCount];
+	GLuint transparentDrawArgs[FrameCount];
+
+	// World space bounds, used for chunk level culling
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	// Visibility history, lets cullChunks() reuse the previous cull results
+	// instead of dispatching the cull shader again when nothing changed
+	glm::mat4 culledViewProj;
+	glm::ivec3 culledCameraCellMin;
+	glm::ivec3 culledCameraCellMax;
+	uint64_t slotLastUsedFrame[FrameCount];
+	uint32_t culledSlot;
+	uint8_t culledFrustumState;
+	uint8_t visibleFaceMask;
+	bool hasCullResults;
+	bool isVisible;
+	bool wasVisible;
+
+	// Allocated bytes of the buffers, a remesh writes into them as long as the new mesh fits
+	GLsizeiptr positionCapacity;
+	GLsizeiptr texcoordCapacity;
+	GLsizeiptr normalCapacity;
+	GLsizeiptr lightCapacity;
+	GLsizeiptr clusterCapacity;
+	GLsizeiptr opaqueIndexCapacity;
+	GLsizeiptr culledOpaqueIndexCapacity;
+	GLsizeiptr transparentIndexCapacity;
+	GLsizeiptr culledTransparentIndexCapacity;
 };
 
-void initChunk(Chunk& chunk, int32_t x, int32_t y, int32_t z);
-void initVisualChunk(VisualChunk& visualChunk, const Chunk& chunk);
+// Meshes the chunk with the voxels of the neighbouring chunks around it, faces on the chunk border are culled against
+// them and every vertex gets the ambient occlusion and smoothed light of its corner
+void initVisualChunk(VisualChunk& visualChunk, const World& world, const Chunk& chunk);
+
+// Remeshes the sections in sectionMask after their blocks or light changed, reusing the GL objects and allocations of initVisualChunk()
+void updateVisualChunk(VisualChunk& visualChunk, const World& world, const Chunk& chunk, uint32_t sectionMask);
 
 struct CullChunkParams
 {
 	glm::mat4 matViewProj;
+	glm::vec3 cameraPos;
+};
+
+struct CullStats
+{
+	uint32_t visibleChunks;
+	uint32_t reusedChunks;
+	uint32_t dispatchedChunks;
 };
 
-void cullChunk(const VisualChunk& chunk, const CullChunkParams& params);
+// Culls whole chunks against the view frustum and dispatches per-quad culling for the visible ones,
+// outDrawList receives the visible chunks with the ones that were already visible last frame first
+void cullChunks(std::vector<VisualChunk>& chunks, const CullChunkParams& params, std::vector<const VisualChunk*>& outDrawList, CullStats* outStats = nullptr);
 void drawChunkOpaque(const VisualChunk& chunk);
 void drawChunkTransparent(const VisualChunk& chunk);
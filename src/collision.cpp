@@ -0,0 +1,164 @@
+#include "collision.h"
+#include "chunk.h"
+#include "occupancy.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "tracy/Tracy.hpp"
+
+bool isBoxSolid(const World& world, const BlockBox& box)
+{
+	if (box.minY < 0)
+		return true;
+
+	const int32_t worldTop = WorldHeightChunks * static_cast<int32_t>(ChunkHeight) - 1;
+	if (box.minY > worldTop)
+		return false;
+
+	const int32_t boxMaxY = std::min(box.maxY, worldTop);
+
+	for (int32_t chunkZ = getChunkCoord(box.minZ, ChunkDepth); chunkZ <= getChunkCoord(box.maxZ, ChunkDepth); ++chunkZ)
+	{
+		for (int32_t chunkY = getChunkCoord(box.minY, ChunkHeight); chunkY <= getChunkCoord(boxMaxY, ChunkHeight); ++chunkY)
+		{
+			for (int32_t chunkX = getChunkCoord(box.minX, ChunkWidth); chunkX <= getChunkCoord(box.maxX, ChunkWidth); ++chunkX)
+			{
+				const Chunk* chunk = findChunk(world, { chunkX, chunkY, chunkZ });
+				if (!chunk || !chunk->isComplete)
+					return true;
+
+				const ChunkOccupancy& occupancy = chunk->occupancy;
+				if (occupancy.solidCount == 0)
+					continue;
+
+				const int32_t chunkMinX = chunkX * static_cast<int32_t>(ChunkWidth);
+				const int32_t chunkMinY = chunkY * static_cast<int32_t>(ChunkHeight);
+				const int32_t chunkMinZ = chunkZ * static_cast<int32_t>(ChunkDepth);
+
+				const int32_t minX = std::max(box.minX, chunkMinX) - chunkMinX;
+				const int32_t maxX = std::min(box.maxX, chunkMinX + static_cast<int32_t>(ChunkWidth) - 1) - chunkMinX;
+				const int32_t minY = std::max(box.minY, chunkMinY) - chunkMinY;
+				const int32_t maxY = std::min(boxMaxY, chunkMinY + static_cast<int32_t>(ChunkHeight) - 1) - chunkMinY;
+				const int32_t minZ = std::max(box.minZ, chunkMinZ) - chunkMinZ;
+				const int32_t maxZ = std::min(box.maxZ, chunkMinZ + static_cast<int32_t>(ChunkDepth) - 1) - chunkMinZ;
+
+				// Rows of x are 16 bit runs of the occupancy words, one mask tests the whole x range of a row
+				const uint64_t rowMask = ((uint64_t(1) << (maxX - minX + 1)) - 1) << minX;
+				for (int32_t z = minZ; z <= maxZ; ++z)
+				{
+					for (int32_t y = minY; y <= maxY; ++y)
+					{
+						const size_t rowIndex = getVoxelIndex(0, y, z);
+						if ((occupancy.voxels[rowIndex / 64] >> (rowIndex % 64)) & rowMask)
+							return true;
+					}
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+// Blocks the box overlaps, a box face on a block boundary doesn't overlap the block beyond it
+static BlockBox getOverlappedBlocks(const Aabb& box)
+{
+	return
+	{
+		static_cast<int32_t>(floorf(box.min.x)),
+		static_cast<int32_t>(floorf(box.min.y)),
+		static_cast<int32_t>(floorf(box.min.z)),
+		static_cast<int32_t>(ceilf(box.max.x)) - 1,
+		static_cast<int32_t>(ceilf(box.max.y)) - 1,
+		static_cast<int32_t>(ceilf(box.max.z)) - 1
+	};
+}
+
+static int32_t& getMin(BlockBox& box, int32_t axis)
+{
+	return axis == 0 ? box.minX : axis == 1 ? box.minY : box.minZ;
+}
+
+static int32_t& getMax(BlockBox& box, int32_t axis)
+{
+	return axis == 0 ? box.maxX : axis == 1 ? box.maxY : box.maxZ;
+}
+
+MoveResult moveAabb(const World& world, Aabb& box, const glm::vec3& motion)
+{
+	ZoneScoped;
+
+	MoveResult result = { glm::vec3(0.0f), { false, false, false } };
+
+	static const int32_t axisOrder[3] = { 1, 0, 2 };
+	for (int32_t axis : axisOrder)
+	{
+		const float axisMotion = motion[axis];
+		if (axisMotion == 0.0f)
+			continue;
+
+		// Layers of blocks the leading face of the box sweeps through, nearest first
+		BlockBox layers = getOverlappedBlocks(box);
+		int32_t firstLayer;
+		int32_t lastLayer;
+		if (axisMotion > 0.0f)
+		{
+			firstLayer = static_cast<int32_t>(ceilf(box.max[axis]));
+			lastLayer = static_cast<int32_t>(ceilf(box.max[axis] + axisMotion)) - 1;
+			getMin(layers, axis) = firstLayer;
+			getMax(layers, axis) = lastLayer;
+		}
+		else
+		{
+			firstLayer = static_cast<int32_t>(floorf(box.min[axis])) - 1;
+			lastLayer = static_cast<int32_t>(floorf(box.min[axis] + axisMotion));
+			getMin(layers, axis) = lastLayer;
+			getMax(layers, axis) = firstLayer;
+		}
+
+		// Most moves don't hit anything, one query over the whole swept box settles those
+		bool isBlocked = false;
+		if (getMin(layers, axis) <= getMax(layers, axis) && isBoxSolid(world, layers))
+		{
+			const int32_t step = axisMotion > 0.0f ? 1 : -1;
+			for (int32_t layer = firstLayer; layer != lastLayer + step; layer += step)
+			{
+				BlockBox layerBlocks = layers;
+				getMin(layerBlocks, axis) = layer;
+				getMax(layerBlocks, axis) = layer;
+				if (!isBoxSolid(world, layerBlocks))
+					continue;
+
+				// Snap the leading face exactly onto the block, a face that rounds past it would let the box
+				// overlap the block and walk through it on the next move
+				const float size = box.max[axis] - box.min[axis];
+				const float oldMin = box.min[axis];
+				if (step > 0)
+				{
+					box.max[axis] = static_cast<float>(layer);
+					box.min[axis] = box.max[axis] - size;
+				}
+				else
+				{
+					box.min[axis] = static_cast<float>(layer + 1);
+					box.max[axis] = box.min[axis] + size;
+				}
+
+				result.motion[axis] = box.min[axis] - oldMin;
+				result.isBlocked[axis] = true;
+				isBlocked = true;
+				break;
+			}
+		}
+
+		if (!isBlocked)
+		{
+			box.min[axis] += axisMotion;
+			box.max[axis] += axisMotion;
+			result.motion[axis] = axisMotion;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "world.h"
+
+#include <glm/vec3.hpp>
+
+struct Aabb
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+struct MoveResult
+{
+	// Motion the box was actually moved by
+	glm::vec3 motion;
+
+	// Axes x, y and z on which a solid block stopped the motion
+	bool isBlocked[3];
+};
+
+// Whether any block of the box is solid, tested against the occupancy bits of the chunks. Blocks below the
+// world and blocks of missing or incomplete chunks within the world height count as solid
+bool isBoxSolid(const World& world, const BlockBox& box);
+
+// Moves the box by motion one axis at a time, y first, then x and z. Each axis stops where the box runs into the
+// first solid block, so boxes slide along walls and floors. Blocks the box already overlaps don't stop it
+MoveResult moveAabb(const World& world, Aabb& box, const glm::vec3& motion);
@@ -0,0 +1,470 @@
+#include "editlog.h"
+#include "chunk.h"
+#include "nxlink.h"
+#include "occupancy.h"
+#include "storage.h"
+
+#include "tracy/Tracy.hpp"
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+constexpr uint32_t EditBatchMagic = 0x54494445; // "EDIT"
+
+// A fold starts once this much was logged, or after FoldInterval when anything was edited at all
+constexpr size_t FoldLogBytes = 256 * 1024;
+constexpr std::chrono::seconds FoldInterval(30);
+
+// Records are written in batches, one per flush. A batch that doesn't match its checksum was torn
+// by a crash and ends the log.
+struct EditBatchHeader
+{
+	uint32_t magic;
+	uint32_t recordCount;
+	uint32_t checksum;
+};
+
+static uint32_t getChecksum(const EditRecord* records, size_t count)
+{
+	// FNV-1a
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(records);
+	uint32_t hash = 2166136261u;
+	for (size_t byteIt = 0; byteIt < count * sizeof(EditRecord); ++byteIt)
+	{
+		hash = (hash ^ bytes[byteIt]) * 16777619u;
+	}
+	return hash;
+}
+
+bool CEditLog::Init(CWorldStorage* storage)
+{
+	_storage = storage;
+	_directory = storage->GetDirectory();
+
+	if (mtx_init(&_ioMutex, mtx_plain) != thrd_success || cnd_init(&_ioCondition) != thrd_success)
+	{
+		TRACE("Could not create edit log I/O synchronisation");
+		return false;
+	}
+
+	if (!_ioJobs.Init(1))
+	{
+		TRACE("Could not start edit log I/O worker");
+		return false;
+	}
+
+	// Logs still around were not folded yet
+	DIR* dir = opendir(_directory.c_str());
+	if (dir)
+	{
+		while (const dirent* dirEntry = readdir(dir))
+		{
+			uint32_t generation;
+			int nameLength = 0;
+			if (sscanf(dirEntry->d_name, "edits.%u.log%n", &generation, &nameLength) == 1 && dirEntry->d_name[nameLength] == '\0')
+			{
+				_oldGenerations.push_back(generation);
+			}
+		}
+		closedir(dir);
+	}
+
+	std::sort(_oldGenerations.begin(), _oldGenerations.end());
+	for (uint32_t generation : _oldGenerations)
+	{
+		ReplayLog(GetLogPath(generation));
+	}
+
+	_generation = _oldGenerations.empty() ? 1 : _oldGenerations.back() + 1;
+	_lastFoldTime = std::chrono::steady_clock::now();
+	_loggedBytes = 0;
+
+	return OpenLog(_generation);
+}
+
+void CEditLog::Deinit(const World& world)
+{
+	Flush();
+	FinishFold(true);
+
+	if (!_dirtyChunks.empty())
+	{
+		StartFold(world);
+		FinishFold(true);
+	}
+
+	// Edits appended while the worker was busy are still pending, write them before the worker stops
+	WaitForLogJobs();
+	Flush();
+	WaitForLogJobs();
+
+	if (_file)
+	{
+		fclose(_file);
+		_file = nullptr;
+	}
+
+	// Nothing in the current log, don't leave it behind
+	if (_loggedBytes == 0)
+	{
+		remove(GetLogPath(_generation).c_str());
+	}
+
+	_ioJobs.Deinit();
+	cnd_destroy(&_ioCondition);
+	mtx_destroy(&_ioMutex);
+}
+
+void CEditLog::Append(const ChunkCoord& coord, uint32_t voxelIndex, uint32_t oldBlock, uint32_t newBlock)
+{
+	_pendingRecords.push_back({ coord.x, coord.y, coord.z, voxelIndex, oldBlock, newBlock });
+	_dirtyChunks.insert(coord);
+}
+
+bool CEditLog::Flush()
+{
+	// Double buffered, the worker writes one batch while the next one fills up
+	mtx_lock(&_ioMutex);
+	const bool hasFailed = _hasWriteFailed;
+	const bool isHandedOff = !_isWriteQueued && !_pendingRecords.empty();
+	if (isHandedOff)
+	{
+		_writeRecords.swap(_pendingRecords);
+		_isWriteQueued = true;
+		++_logJobCount;
+	}
+	mtx_unlock(&_ioMutex);
+
+	if (isHandedOff)
+	{
+		_loggedBytes += sizeof(EditBatchHeader) + _writeRecords.size() * sizeof(EditRecord);
+		_pendingRecords.clear();
+		_ioJobs.Push(RunWrite, this);
+	}
+	return !hasFailed;
+}
+
+void CEditLog::ApplyReplayedEdits(World& world, Chunk& chunk)
+{
+	auto it = _replayedEdits.find({ chunk.x, chunk.y, chunk.z });
+	if (it == _replayedEdits.end())
+		return;
+
+	for (const EditRecord& record : it->second)
+	{
+		if (record.voxelIndex >= ChunkVoxelCount)
+			continue;
+
+		chunk.blocks[record.voxelIndex] = record.newBlock;
+		markVoxelEdited(chunk, record.voxelIndex);
+		updateVoxelOccupancy(chunk, record.voxelIndex, record.newBlock);
+
+		const int32_t x = chunk.x * static_cast<int32_t>(ChunkWidth) + static_cast<int32_t>(record.voxelIndex % ChunkWidth);
+		const int32_t y = chunk.y * static_cast<int32_t>(ChunkHeight) + static_cast<int32_t>(record.voxelIndex / ChunkWidth % ChunkHeight);
+		const int32_t z = chunk.z * static_cast<int32_t>(ChunkDepth) + static_cast<int32_t>(record.voxelIndex / (ChunkWidth * ChunkHeight));
+		updateColumnInfo(world, x, y, z, record.newBlock);
+	}
+
+	_dirtyChunks.insert(it->first);
+	_replayedEdits.erase(it);
+}
+
+void CEditLog::Update(const World& world)
+{
+	FinishFold(false);
+
+	if (_foldJob || _dirtyChunks.empty())
+		return;
+
+	if (_loggedBytes >= FoldLogBytes || std::chrono::steady_clock::now() - _lastFoldTime >= FoldInterval)
+	{
+		StartFold(world);
+	}
+}
+
+void CEditLog::RunWrite(void* userData)
+{
+	CEditLog* editLog = static_cast<CEditLog*>(userData);
+
+	const bool isWritten = editLog->WriteRecords(editLog->_writeRecords.data(), editLog->_writeRecords.size());
+	editLog->_writeRecords.clear();
+
+	mtx_lock(&editLog->_ioMutex);
+	editLog->_isWriteQueued = false;
+	mtx_unlock(&editLog->_ioMutex);
+	editLog->FinishLogJobs(isWritten);
+}
+
+void CEditLog::RunSeal(void* userData)
+{
+	ZoneScoped;
+
+	SealJob* job = static_cast<SealJob*>(userData);
+	CEditLog* editLog = job->editLog;
+
+	if (editLog->_file)
+	{
+		fclose(editLog->_file);
+	}
+
+	bool isWritten = editLog->OpenLog(job->generation);
+	if (isWritten && !job->carriedRecords.empty())
+	{
+		isWritten = editLog->WriteRecords(job->carriedRecords.data(), job->carriedRecords.size());
+	}
+
+	delete job;
+	editLog->FinishLogJobs(isWritten);
+}
+
+void CEditLog::RunRemove(void* userData)
+{
+	RemoveJob* job = static_cast<RemoveJob*>(userData);
+	CEditLog* editLog = job->editLog;
+
+	for (uint32_t generation : job->generations)
+	{
+		remove(editLog->GetLogPath(generation).c_str());
+	}
+
+	delete job;
+	editLog->FinishLogJobs(true);
+}
+
+void CEditLog::RunFold(void* userData)
+{
+	ZoneScoped;
+
+	FoldJob* job = static_cast<FoldJob*>(userData);
+	CEditLog* editLog = job->editLog;
+
+	job->isSaved = editLog->_storage->SaveChunks(job->snapshots);
+
+	mtx_lock(&editLog->_ioMutex);
+	editLog->_isFoldFinished = true;
+	cnd_broadcast(&editLog->_ioCondition);
+	mtx_unlock(&editLog->_ioMutex);
+}
+
+bool CEditLog::OpenLog(uint32_t generation)
+{
+	_file = fopen(GetLogPath(generation).c_str(), "ab");
+	_fileGeneration = generation;
+
+	if (!_file)
+	{
+		TRACE("Could not open edit log %s", GetLogPath(generation).c_str());
+		return false;
+	}
+	return true;
+}
+
+bool CEditLog::ReplayLog(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	// A torn batch can have any record count, it's never allowed to claim more than the rest of the file
+	long fileSize = -1;
+	if (fseek(file, 0, SEEK_END) == 0)
+	{
+		fileSize = ftell(file);
+	}
+	if (fileSize < 0 || fseek(file, 0, SEEK_SET) != 0)
+	{
+		TRACE("Could not read edit log %s", path.c_str());
+		fclose(file);
+		return false;
+	}
+
+	std::vector<EditRecord> records;
+	EditBatchHeader header;
+	while (fread(&header, sizeof(header), 1, file) == 1)
+	{
+		const size_t remainingBytes = static_cast<size_t>(fileSize - ftell(file));
+		if (header.magic != EditBatchMagic || header.recordCount > remainingBytes / sizeof(EditRecord))
+		{
+			TRACE("Edit log %s ends in a torn batch", path.c_str());
+			break;
+		}
+
+		records.resize(header.recordCount);
+		if (fread(records.data(), sizeof(EditRecord), records.size(), file) != records.size()
+			|| getChecksum(records.data(), records.size()) != header.checksum)
+		{
+			TRACE("Edit log %s ends in a torn batch", path.c_str());
+			break;
+		}
+
+		for (const EditRecord& record : records)
+		{
+			_replayedEdits[{ record.chunkX, record.chunkY, record.chunkZ }].push_back(record);
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool CEditLog::WriteRecords(const EditRecord* records, size_t count)
+{
+	ZoneScoped;
+
+	if (!_file)
+		return false;
+
+	const EditBatchHeader header = { EditBatchMagic, static_cast<uint32_t>(count), getChecksum(records, count) };
+	if (fwrite(&header, sizeof(header), 1, _file) != 1 || fwrite(records, sizeof(EditRecord), count, _file) != count
+		|| fflush(_file) != 0 || fsync(fileno(_file)) != 0)
+	{
+		TRACE("Could not write edit log %s", GetLogPath(_fileGeneration).c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void CEditLog::PushLogJob(CJobSystem::JobFunction function, void* userData)
+{
+	mtx_lock(&_ioMutex);
+	++_logJobCount;
+	mtx_unlock(&_ioMutex);
+
+	_ioJobs.Push(function, userData);
+}
+
+void CEditLog::FinishLogJobs(bool wasWritten)
+{
+	mtx_lock(&_ioMutex);
+	_hasWriteFailed = _hasWriteFailed || !wasWritten;
+	--_logJobCount;
+	cnd_broadcast(&_ioCondition);
+	mtx_unlock(&_ioMutex);
+}
+
+void CEditLog::WaitForLogJobs()
+{
+	mtx_lock(&_ioMutex);
+	while (_logJobCount != 0)
+	{
+		cnd_wait(&_ioCondition, &_ioMutex);
+	}
+	mtx_unlock(&_ioMutex);
+}
+
+void CEditLog::StartFold(const World& world)
+{
+	ZoneScoped;
+
+	// Edits still pending when the worker is busy go into the next generation, which the fold doesn't remove
+	Flush();
+
+	// Seal the current log, edits from now on go into the next generation
+	_oldGenerations.push_back(_generation);
+	SealJob* sealJob = new SealJob();
+	sealJob->editLog = this;
+	sealJob->generation = ++_generation;
+
+	// Replayed edits of chunks that aren't loaded can't be folded, carry them over
+	for (const auto& entry : _replayedEdits)
+	{
+		sealJob->carriedRecords.insert(sealJob->carriedRecords.end(), entry.second.begin(), entry.second.end());
+	}
+	_loggedBytes = sealJob->carriedRecords.empty() ? 0 : sizeof(EditBatchHeader) + sealJob->carriedRecords.size() * sizeof(EditRecord);
+	PushLogJob(RunSeal, sealJob);
+
+	FoldJob* job = new FoldJob();
+	job->editLog = this;
+	job->generation = _generation;
+	job->isSaved = false;
+	job->snapshots.reserve(_dirtyChunks.size());
+
+	// A snapshot shares the blocks, the live chunk only copies them on its next edit
+	for (const ChunkCoord& coord : _dirtyChunks)
+	{
+		const Chunk* chunk = findChunk(world, coord);
+		if (chunk && chunk->isComplete)
+		{
+			job->snapshots.push_back(getChunkSnapshot(*chunk));
+		}
+	}
+
+	_dirtyChunks.clear();
+	_lastFoldTime = std::chrono::steady_clock::now();
+
+	_isFoldFinished = false;
+	_foldJob = job;
+	_ioJobs.Push(RunFold, job);
+}
+
+void CEditLog::FinishFold(bool wait)
+{
+	if (!_foldJob)
+		return;
+
+	mtx_lock(&_ioMutex);
+	while (wait && !_isFoldFinished)
+	{
+		cnd_wait(&_ioCondition, &_ioMutex);
+	}
+	const bool isFinished = _isFoldFinished;
+	mtx_unlock(&_ioMutex);
+
+	if (!isFinished)
+		return;
+
+	if (_foldJob->isSaved)
+	{
+		RemoveLogsBefore(_foldJob->generation);
+	}
+	else
+	{
+		// The logs stay, the chunks go into the next fold again
+		TRACE("Could not fold the edit log into the region files");
+		for (const ChunkSnapshot& snapshot : _foldJob->snapshots)
+		{
+			_dirtyChunks.insert({ snapshot.x, snapshot.y, snapshot.z });
+		}
+	}
+
+	delete _foldJob;
+	_foldJob = nullptr;
+}
+
+void CEditLog::RemoveLogsBefore(uint32_t generation)
+{
+	// On the worker, after the log it seals was closed
+	RemoveJob* job = new RemoveJob();
+	job->editLog = this;
+
+	auto it = _oldGenerations.begin();
+	while (it != _oldGenerations.end())
+	{
+		if (*it < generation)
+		{
+			job->generations.push_back(*it);
+			it = _oldGenerations.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	if (job->generations.empty())
+	{
+		delete job;
+		return;
+	}
+	PushLogJob(RunRemove, job);
+}
+
+std::string CEditLog::GetLogPath(uint32_t generation) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/edits.%u.log", generation);
+	return _directory + name;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "jobs.h"
+#include "world.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class CWorldStorage;
+struct Chunk;
+struct ChunkSnapshot;
+
+struct EditRecord
+{
+	int32_t chunkX;
+	int32_t chunkY;
+	int32_t chunkZ;
+	uint32_t voxelIndex;
+	uint32_t oldBlock;
+	uint32_t newBlock;
+};
+
+// Write-ahead log of block edits. Edits are appended in memory, and once per frame the batch is handed
+// to an I/O worker that writes it to the log file and syncs it, appending is all a save costs on the
+// main thread. While the worker is still writing a batch, the next one keeps growing and goes out once
+// it's done. Every now and then the log is folded into the region files: the edited chunks are
+// snapshotted, which only shares their copy-on-write blocks, and the same worker serialises and
+// compresses the snapshots while the live chunks keep being edited. The log files the fold covers are
+// deleted once it is written.
+// Logs left over from a crash are replayed into chunks as they complete.
+//
+// Log files are numbered generations and a fold starts a new one, so a fold only removes the
+// generations before it and never the edits made while it runs. The worker runs its jobs in order,
+// so a log is only sealed or removed after the batches handed to it before.
+class CEditLog
+{
+public:
+	bool Init(CWorldStorage* storage);
+	// Folds what is left and waits for it
+	void Deinit(const World& world);
+
+	void Append(const ChunkCoord& coord, uint32_t voxelIndex, uint32_t oldBlock, uint32_t newBlock);
+	// Hands the edits appended since the last call to the I/O worker unless it's still writing the previous
+	// batch, call once per frame. False once writing the log failed
+	bool Flush();
+
+	// Applies the edits replayed from earlier runs to a chunk that just completed, main thread only
+	void ApplyReplayedEdits(World& world, Chunk& chunk);
+
+	// Starts a fold once enough was logged and finishes the previous one, call once per frame
+	void Update(const World& world);
+
+private:
+	struct FoldJob
+	{
+		CEditLog* editLog;
+		uint32_t generation;
+		std::vector<ChunkSnapshot> snapshots;
+		bool isSaved;
+	};
+
+	struct SealJob
+	{
+		CEditLog* editLog;
+		uint32_t generation;
+		// Replayed edits of chunks that aren't loaded, carried over into the new log
+		std::vector<EditRecord> carriedRecords;
+	};
+
+	struct RemoveJob
+	{
+		CEditLog* editLog;
+		std::vector<uint32_t> generations;
+	};
+
+	static void RunWrite(void* userData);
+	static void RunSeal(void* userData);
+	static void RunRemove(void* userData);
+	static void RunFold(void* userData);
+
+	bool OpenLog(uint32_t generation);
+	bool ReplayLog(const std::string& path);
+	bool WriteRecords(const EditRecord* records, size_t count);
+	void PushLogJob(CJobSystem::JobFunction function, void* userData);
+	void FinishLogJobs(bool wasWritten);
+	void WaitForLogJobs();
+	void StartFold(const World& world);
+	void FinishFold(bool wait);
+	void RemoveLogsBefore(uint32_t generation);
+	std::string GetLogPath(uint32_t generation) const;
+
+	CWorldStorage* _storage;
+	std::string _directory;
+
+	// I/O worker only once it runs
+	FILE* _file = nullptr;
+	uint32_t _fileGeneration = 0;
+
+	uint32_t _generation = 0;
+	std::vector<uint32_t> _oldGenerations;
+	std::vector<EditRecord> _pendingRecords;
+	// Bytes handed to the worker for the current log
+	size_t _loggedBytes = 0;
+	std::chrono::steady_clock::time_point _lastFoldTime;
+
+	// Edits of chunks that didn't complete yet, from logs of earlier runs
+	std::unordered_map<ChunkCoord, std::vector<EditRecord>, ChunkCoordHash> _replayedEdits;
+	// Chunks edited since they were last folded
+	std::unordered_set<ChunkCoord, ChunkCoordHash> _dirtyChunks;
+
+	CJobSystem _ioJobs;
+	FoldJob* _foldJob = nullptr;
+
+	// Guard the state shared with the I/O worker
+	mtx_t _ioMutex;
+	cnd_t _ioCondition;
+	bool _isFoldFinished = false;
+	// The batch being written, only touched by the worker while a write is queued
+	std::vector<EditRecord> _writeRecords;
+	bool _isWriteQueued = false;
+	bool _hasWriteFailed = false;
+	uint32_t _logJobCount = 0;
+};
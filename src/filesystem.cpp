@@ -0,0 +1,40 @@
+#include "filesystem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool createDirectories(const std::string& path)
+{
+	for (size_t separator = path.find('/'); ; separator = path.find('/', separator + 1))
+	{
+		const std::string parent = path.substr(0, separator);
+		// Skip the device ("sdmc:") and the root
+		if (!parent.empty() && parent.back() != ':' && mkdir(parent.c_str(), 0777) != 0 && errno != EEXIST)
+			return false;
+
+		if (separator == std::string::npos)
+			return true;
+	}
+}
+
+bool syncParentDirectory(const std::string& path)
+{
+#ifdef __SWITCH__
+	// Directories can't be opened on the Switch, the file system commits renames itself
+	(void)path;
+	return true;
+#else
+	const size_t separator = path.rfind('/');
+	const std::string parent = separator == std::string::npos ? "." : separator == 0 ? "/" : path.substr(0, separator);
+
+	const int directory = open(parent.c_str(), O_RDONLY | O_DIRECTORY);
+	if (directory < 0)
+		return false;
+
+	const bool isSynced = fsync(directory) == 0;
+	close(directory);
+	return isSynced;
+#endif
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// Creates the directory and all missing parents, like mkdir -p
+bool createDirectories(const std::string& path);
+// Makes renames and removals of the entries of the directory holding path durable, the parent's fsync() on POSIX
+bool syncParentDirectory(const std::string& path);
@@ -0,0 +1,97 @@
+#include "jobs.h"
+#include "nxlink.h"
+
+#include <algorithm>
+
+bool CJobSystem::Init(uint32_t workerCount)
+{
+	if (mtx_init(&_mutex, mtx_plain) != thrd_success)
+	{
+		TRACE("Could not create job mutex");
+		return false;
+	}
+
+	if (cnd_init(&_condition) != thrd_success)
+	{
+		TRACE("Could not create job condition variable");
+		mtx_destroy(&_mutex);
+		return false;
+	}
+
+	_isStopping = false;
+	_workerCount = 0;
+
+	workerCount = std::min(workerCount, MaxWorkerCount);
+	for (uint32_t workerIt = 0; workerIt < workerCount; ++workerIt)
+	{
+		if (thrd_create(&_workers[_workerCount], WorkerMain, this) != thrd_success)
+		{
+			TRACE("Could not create worker thread %u", workerIt);
+			break;
+		}
+		++_workerCount;
+	}
+
+	return _workerCount > 0;
+}
+
+void CJobSystem::Deinit(JobFunction cancelFunction)
+{
+	mtx_lock(&_mutex);
+	_isStopping = true;
+	cnd_broadcast(&_condition);
+	mtx_unlock(&_mutex);
+
+	for (uint32_t workerIt = 0; workerIt < _workerCount; ++workerIt)
+	{
+		thrd_join(_workers[workerIt], nullptr);
+	}
+	_workerCount = 0;
+
+	if (cancelFunction)
+	{
+		for (const Job& job : _jobs)
+		{
+			cancelFunction(job.userData);
+		}
+	}
+	_jobs.clear();
+
+	cnd_destroy(&_condition);
+	mtx_destroy(&_mutex);
+}
+
+void CJobSystem::Push(JobFunction function, void* userData)
+{
+	mtx_lock(&_mutex);
+	_jobs.push_back({ function, userData });
+	cnd_signal(&_condition);
+	mtx_unlock(&_mutex);
+}
+
+int CJobSystem::WorkerMain(void* userData)
+{
+	CJobSystem* jobSystem = static_cast<CJobSystem*>(userData);
+
+	mtx_lock(&jobSystem->_mutex);
+	while (true)
+	{
+		while (jobSystem->_jobs.empty() && !jobSystem->_isStopping)
+		{
+			cnd_wait(&jobSystem->_condition, &jobSystem->_mutex);
+		}
+
+		if (jobSystem->_isStopping)
+			break;
+
+		const Job job = jobSystem->_jobs.front();
+		jobSystem->_jobs.pop_front();
+
+		mtx_unlock(&jobSystem->_mutex);
+		job.function(job.userData);
+		mtx_lock(&jobSystem->_mutex);
+	}
+	mtx_unlock(&jobSystem->_mutex);
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <threads.h>
+
+#include <deque>
+
+// Fixed pool of worker threads running jobs in submission order
+class CJobSystem
+{
+public:
+	typedef void (*JobFunction)(void* userData);
+
+	static constexpr uint32_t MaxWorkerCount = 4;
+
+	bool Init(uint32_t workerCount);
+	// Waits for the running jobs, jobs that haven't started are dropped and cancelFunction is called on them
+	void Deinit(JobFunction cancelFunction = nullptr);
+
+	void Push(JobFunction function, void* userData);
+
+private:
+	struct Job
+	{
+		JobFunction function;
+		void* userData;
+	};
+
+	static int WorkerMain(void* userData);
+
+	thrd_t _workers[MaxWorkerCount];
+	uint32_t _workerCount = 0;
+
+	mtx_t _mutex;
+	cnd_t _condition;
+	std::deque<Job> _jobs;
+	bool _isStopping = false;
+};
@@ -0,0 +1,798 @@
+#include "light.h"
+#include "block.h"
+#include "nxlink.h"
+#include "occupancy.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "tracy/Tracy.hpp"
+
+struct LightNode
+{
+	Chunk* chunk;
+	uint16_t voxelIndex;
+	uint8_t level;
+};
+
+// Far more nodes than any update keeps queued, light reaches no further than MaxLightLevel blocks
+constexpr uint32_t LightQueueCapacity = 1 << 16;
+
+static_assert((LightQueueCapacity & (LightQueueCapacity - 1)) == 0, "The queue indices wrap around");
+
+// First in, first out ring buffer of light nodes with a fixed capacity, propagation never allocates
+class CLightQueue
+{
+public:
+	bool IsEmpty() const
+	{
+		return _head == _tail;
+	}
+
+	// False if the queue is full, the node is dropped then
+	bool Push(const LightNode& node)
+	{
+		if (_tail - _head == LightQueueCapacity)
+			return false;
+
+		_nodes[_tail++ % LightQueueCapacity] = node;
+		return true;
+	}
+
+	LightNode Pop()
+	{
+		return _nodes[_head++ % LightQueueCapacity];
+	}
+
+private:
+	LightNode _nodes[LightQueueCapacity];
+	uint32_t _head = 0;
+	uint32_t _tail = 0;
+};
+
+// Voxels to spread light from, and voxels whose light was taken out along with the level they had
+static CLightQueue g_lightQueue;
+static CLightQueue g_unlightQueue;
+
+// Blocks whose light an update changed, of block light or of sky light. Both spread the same way
+struct LightUpdate
+{
+	World& world;
+	BlockBox changedBox;
+	bool isChanged;
+	bool isSkyLight;
+};
+
+static void pushNode(CLightQueue& queue, Chunk* chunk, size_t voxelIndex, uint8_t level)
+{
+	if (!queue.Push({ chunk, static_cast<uint16_t>(voxelIndex), level }))
+	{
+		TRACE("Light queue is full, light around chunk %d %d %d stays incomplete", chunk->x, chunk->y, chunk->z);
+	}
+}
+
+static uint8_t getLight(const LightUpdate& update, const Chunk& chunk, size_t voxelIndex)
+{
+	return update.isSkyLight ? getSkyLight(chunk, voxelIndex) : getBlockLight(chunk, voxelIndex);
+}
+
+static void setLight(LightUpdate& update, Chunk& chunk, size_t voxelIndex, uint8_t level)
+{
+	if (update.isSkyLight)
+	{
+		setSkyLight(chunk, voxelIndex, level);
+	}
+	else
+	{
+		setBlockLight(chunk, voxelIndex, level);
+	}
+
+	const int32_t x = chunk.x * static_cast<int32_t>(ChunkWidth) + static_cast<int32_t>(voxelIndex % ChunkWidth);
+	const int32_t y = chunk.y * static_cast<int32_t>(ChunkHeight) + static_cast<int32_t>(voxelIndex / ChunkWidth % ChunkHeight);
+	const int32_t z = chunk.z * static_cast<int32_t>(ChunkDepth) + static_cast<int32_t>(voxelIndex / (ChunkWidth * ChunkHeight));
+
+	BlockBox& box = update.changedBox;
+	if (!update.isChanged)
+	{
+		box = { x, y, z, x, y, z };
+		update.isChanged = true;
+		return;
+	}
+
+	box.minX = std::min(box.minX, x);
+	box.minY = std::min(box.minY, y);
+	box.minZ = std::min(box.minZ, z);
+	box.maxX = std::max(box.maxX, x);
+	box.maxY = std::max(box.maxY, y);
+	box.maxZ = std::max(box.maxZ, z);
+}
+
+// Voxel next to a voxel in direction, in a neighbouring chunk past the border. False if that chunk isn't complete
+static bool getNeighbour(const World& world, Chunk* chunk, size_t voxelIndex, int32_t direction, Chunk*& outChunk, size_t& outVoxelIndex)
+{
+	const glm::ivec3 normal = getFaceNormal(static_cast<FaceDirection>(direction));
+	const int32_t x = static_cast<int32_t>(voxelIndex % ChunkWidth) + normal.x;
+	const int32_t y = static_cast<int32_t>(voxelIndex / ChunkWidth % ChunkHeight) + normal.y;
+	const int32_t z = static_cast<int32_t>(voxelIndex / (ChunkWidth * ChunkHeight)) + normal.z;
+
+	const bool isInsideChunk = x >= 0 && x < static_cast<int32_t>(ChunkWidth) &&
+		y >= 0 && y < static_cast<int32_t>(ChunkHeight) &&
+		z >= 0 && z < static_cast<int32_t>(ChunkDepth);
+	if (isInsideChunk)
+	{
+		outChunk = chunk;
+		outVoxelIndex = getVoxelIndex(x, y, z);
+		return true;
+	}
+
+	Chunk* neighbour = findChunk(world, { chunk->x + normal.x, chunk->y + normal.y, chunk->z + normal.z });
+	if (!neighbour || !neighbour->isComplete)
+		return false;
+
+	outChunk = neighbour;
+	outVoxelIndex = getVoxelIndex(x & (ChunkWidth - 1), y & (ChunkHeight - 1), z & (ChunkDepth - 1));
+	return true;
+}
+
+// Breadth first from the queued voxels, every air voxel ends up one level below its brightest neighbour
+static void spreadLight(LightUpdate& update)
+{
+	while (!g_lightQueue.IsEmpty())
+	{
+		const LightNode node = g_lightQueue.Pop();
+		const uint8_t level = getLight(update, *node.chunk, node.voxelIndex);
+		if (level <= 1)
+			continue;
+
+		for (int32_t direction = 0; direction < FaceDirectionCount; ++direction)
+		{
+			Chunk* chunk;
+			size_t voxelIndex;
+			if (!getNeighbour(update.world, node.chunk, node.voxelIndex, direction, chunk, voxelIndex))
+				continue;
+
+			if (isVoxelOccupied(chunk->occupancy, voxelIndex) || getLight(update, *chunk, voxelIndex) + 1 >= level)
+				continue;
+
+			setLight(update, *chunk, voxelIndex, level - 1);
+			pushNode(g_lightQueue, chunk, voxelIndex, level - 1);
+		}
+	}
+}
+
+// Breadth first from the queued voxels, darkens the voxels that were lit through them. Neighbours at least as
+// bright are lit by something else and are queued to spread their light back into the dark
+static void removeLight(LightUpdate& update)
+{
+	while (!g_unlightQueue.IsEmpty())
+	{
+		const LightNode node = g_unlightQueue.Pop();
+
+		for (int32_t direction = 0; direction < FaceDirectionCount; ++direction)
+		{
+			Chunk* chunk;
+			size_t voxelIndex;
+			if (!getNeighbour(update.world, node.chunk, node.voxelIndex, direction, chunk, voxelIndex))
+				continue;
+
+			const uint8_t level = getLight(update, *chunk, voxelIndex);
+			if (level == 0)
+				continue;
+
+			// The only lit solid voxels are emitters, they keep the light they give off
+			if (level < node.level && !isVoxelOccupied(chunk->occupancy, voxelIndex))
+			{
+				setLight(update, *chunk, voxelIndex, 0);
+				pushNode(g_unlightQueue, chunk, voxelIndex, level);
+			}
+			else
+			{
+				pushNode(g_lightQueue, chunk, voxelIndex, level);
+			}
+		}
+	}
+}
+
+// Queues the neighbours of a voxel that have light to spread into it
+static void pushLitNeighbours(const LightUpdate& update, Chunk& chunk, size_t voxelIndex)
+{
+	for (int32_t direction = 0; direction < FaceDirectionCount; ++direction)
+	{
+		Chunk* neighbourChunk;
+		size_t neighbourIndex;
+		if (!getNeighbour(update.world, &chunk, voxelIndex, direction, neighbourChunk, neighbourIndex))
+			continue;
+
+		const uint8_t level = getLight(update, *neighbourChunk, neighbourIndex);
+		if (level > 1)
+		{
+			pushNode(g_lightQueue, neighbourChunk, neighbourIndex, level);
+		}
+	}
+}
+
+static void finishUpdate(const LightUpdate& update)
+{
+	if (update.isChanged)
+	{
+		markBoxDirty(update.world, update.changedBox);
+	}
+}
+
+// Voxel on the face of a chunk towards direction, a and b go along the two other axes
+static size_t getFaceVoxelIndex(int32_t direction, size_t a, size_t b)
+{
+	switch (direction)
+	{
+	case FaceNegZ: return getVoxelIndex(a, b, 0);
+	case FacePosZ: return getVoxelIndex(a, b, ChunkDepth - 1);
+	case FaceNegY: return getVoxelIndex(a, 0, b);
+	case FacePosY: return getVoxelIndex(a, ChunkHeight - 1, b);
+	case FaceNegX: return getVoxelIndex(0, a, b);
+	default: return getVoxelIndex(ChunkWidth - 1, a, b);
+	}
+}
+
+static_assert(ChunkWidth == ChunkHeight && ChunkHeight == ChunkDepth, "Chunk faces are square");
+
+void initChunkLight(World& world, Chunk& chunk)
+{
+	ZoneScoped;
+
+	memset(chunk.blockLight, 0, sizeof(chunk.blockLight));
+	memset(chunk.skyLight, 0, sizeof(chunk.skyLight));
+	markSkyLightDirty(world, chunk);
+
+	LightUpdate update = { world, {}, false, false };
+
+	// Emitters are solid, only the blocks of solid voxels need to be looked at
+	const uint32_t* blocks = static_cast<const Chunk&>(chunk).blocks.data();
+	for (size_t wordIt = 0; wordIt < ChunkVoxelCount / 64; ++wordIt)
+	{
+		for (uint64_t word = chunk.occupancy.voxels[wordIt]; word != 0; word &= word - 1)
+		{
+			const size_t voxelIndex = wordIt * 64 + __builtin_ctzll(word);
+			const uint8_t emission = getLightEmission(blocks[voxelIndex]);
+			if (emission > 0)
+			{
+				setLight(update, chunk, voxelIndex, emission);
+				pushNode(g_lightQueue, &chunk, voxelIndex, emission);
+			}
+		}
+	}
+
+	// The light of the complete neighbours spreads in across the shared faces. Direction ^ 1 is the opposite one
+	for (int32_t direction = 0; direction < FaceDirectionCount; ++direction)
+	{
+		const glm::ivec3 normal = getFaceNormal(static_cast<FaceDirection>(direction));
+		Chunk* neighbour = findChunk(world, { chunk.x + normal.x, chunk.y + normal.y, chunk.z + normal.z });
+		if (!neighbour || !neighbour->isComplete)
+			continue;
+
+		for (size_t b = 0; b < ChunkWidth; ++b)
+		{
+			for (size_t a = 0; a < ChunkWidth; ++a)
+			{
+				const size_t voxelIndex = getFaceVoxelIndex(direction ^ 1, a, b);
+				const uint8_t level = getBlockLight(*neighbour, voxelIndex);
+				if (level > 1)
+				{
+					pushNode(g_lightQueue, neighbour, voxelIndex, level);
+				}
+			}
+		}
+	}
+
+	spreadLight(update);
+	finishUpdate(update);
+}
+
+void updateBlockLight(World& world, Chunk& chunk, const uint16_t* voxelIndices, size_t voxelCount)
+{
+	ZoneScoped;
+
+	LightUpdate update = { world, {}, false, false };
+	const uint32_t* blocks = static_cast<const Chunk&>(chunk).blocks.data();
+
+	for (size_t voxelIt = 0; voxelIt < voxelCount; ++voxelIt)
+	{
+		const size_t voxelIndex = voxelIndices[voxelIt];
+		const uint8_t oldLevel = getBlockLight(chunk, voxelIndex);
+		const uint32_t block = blocks[voxelIndex];
+
+		// Covers solid blocks replacing each other in the dark, by far the most common edit
+		if (oldLevel == 0 || (isSolidBlock(block) && oldLevel == getLightEmission(block)))
+			continue;
+
+		setLight(update, chunk, voxelIndex, 0);
+		pushNode(g_unlightQueue, &chunk, voxelIndex, oldLevel);
+	}
+	removeLight(update);
+
+	for (size_t voxelIt = 0; voxelIt < voxelCount; ++voxelIt)
+	{
+		const size_t voxelIndex = voxelIndices[voxelIt];
+		const uint32_t block = blocks[voxelIndex];
+		const uint8_t emission = getLightEmission(block);
+		if (emission > 0)
+		{
+			setLight(update, chunk, voxelIndex, emission);
+			pushNode(g_lightQueue, &chunk, voxelIndex, emission);
+		}
+
+		// Light can pass through the voxel now, the lit neighbours spread into it
+		if (!isSolidBlock(block))
+		{
+			pushLitNeighbours(update, chunk, voxelIndex);
+		}
+	}
+
+	spreadLight(update);
+	finishUpdate(update);
+}
+
+void markSkyLightDirty(World& world, const Chunk& chunk)
+{
+	world.dirtySkyColumns.insert({ chunk.x, chunk.z });
+}
+
+bool canChangeSkyLight(const World& world, Chunk& chunk, size_t voxelIndex)
+{
+	if (getSkyLight(chunk, voxelIndex) > 0)
+		return true;
+
+	for (int32_t direction = 0; direction < FaceDirectionCount; ++direction)
+	{
+		Chunk* neighbourChunk;
+		size_t neighbourIndex;
+		if (getNeighbour(world, &chunk, voxelIndex, direction, neighbourChunk, neighbourIndex) && getSkyLight(*neighbourChunk, neighbourIndex) > 0)
+			return true;
+	}
+
+	return false;
+}
+
+void updateSkyLight(World& world, Chunk& chunk, const uint16_t* voxelIndices, size_t voxelCount)
+{
+	ZoneScoped;
+
+	LightUpdate update = { world, {}, false, true };
+
+	// Block columns of the chunk with a changed voxel, their highest solid block may have moved
+	uint64_t columnMask[ChunkWidth * ChunkDepth / 64] = {};
+	for (size_t voxelIt = 0; voxelIt < voxelCount; ++voxelIt)
+	{
+		const size_t voxelIndex = voxelIndices[voxelIt];
+		const size_t columnIndex = voxelIndex % ChunkWidth + ChunkWidth * (voxelIndex / (ChunkWidth * ChunkHeight));
+		columnMask[columnIndex / 64] |= uint64_t(1) << (columnIndex % 64);
+
+		const uint8_t level = getSkyLight(chunk, voxelIndex);
+		if (level > 0 && isVoxelOccupied(chunk.occupancy, voxelIndex))
+		{
+			setLight(update, chunk, voxelIndex, 0);
+			pushNode(g_unlightQueue, &chunk, voxelIndex, level);
+		}
+	}
+
+	Chunk* columnChunks[WorldHeightChunks];
+	for (int32_t chunkY = 0; chunkY < WorldHeightChunks; ++chunkY)
+	{
+		Chunk* columnChunk = findChunk(world, { chunk.x, chunkY, chunk.z });
+		columnChunks[chunkY] = columnChunk && columnChunk->isComplete ? columnChunk : nullptr;
+	}
+	const ChunkColumn& column = *findColumn(world, { chunk.x, chunk.z });
+
+	// Only direct sky light is at the full level, where it is left at or below the highest solid block that block
+	// moved up. Once the light it gave is out, the air above the highest solid block gets it back
+	for (int32_t pass = 0; pass < 2; ++pass)
+	{
+		for (size_t wordIt = 0; wordIt < ChunkWidth * ChunkDepth / 64; ++wordIt)
+		{
+			for (uint64_t word = columnMask[wordIt]; word != 0; word &= word - 1)
+			{
+				const size_t columnIndex = wordIt * 64 + __builtin_ctzll(word);
+				const size_t x = columnIndex % ChunkWidth;
+				const size_t z = columnIndex / ChunkWidth;
+				const int32_t height = column.columns[z][x].height;
+
+				for (int32_t chunkY = 0; chunkY < WorldHeightChunks; ++chunkY)
+				{
+					Chunk* columnChunk = columnChunks[chunkY];
+					if (!columnChunk)
+						continue;
+
+					for (size_t localY = 0; localY < ChunkHeight; ++localY)
+					{
+						const int32_t y = chunkY * static_cast<int32_t>(ChunkHeight) + static_cast<int32_t>(localY);
+						const size_t voxelIndex = getVoxelIndex(x, localY, z);
+						const uint8_t level = getSkyLight(*columnChunk, voxelIndex);
+
+						if (pass == 0 && y <= height && level == MaxLightLevel)
+						{
+							setLight(update, *columnChunk, voxelIndex, 0);
+							pushNode(g_unlightQueue, columnChunk, voxelIndex, level);
+						}
+						else if (pass == 1 && y > height && level < MaxLightLevel && !isVoxelOccupied(columnChunk->occupancy, voxelIndex))
+						{
+							setLight(update, *columnChunk, voxelIndex, MaxLightLevel);
+							pushNode(g_lightQueue, columnChunk, voxelIndex, MaxLightLevel);
+						}
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			removeLight(update);
+		}
+	}
+
+	// Light can pass through the voxels that turned into air now, the lit neighbours spread into them
+	for (size_t voxelIt = 0; voxelIt < voxelCount; ++voxelIt)
+	{
+		if (!isVoxelOccupied(chunk.occupancy, voxelIndices[voxelIt]))
+		{
+			pushLitNeighbours(update, chunk, voxelIndices[voxelIt]);
+		}
+	}
+
+	spreadLight(update);
+	finishUpdate(update);
+}
+
+constexpr int32_t WorldHeight = WorldHeightChunks * static_cast<int32_t>(ChunkHeight);
+
+static_assert(WorldHeight <= INT8_MAX, "Block y coordinates are compared in 8 bit lanes");
+
+// Sky light of a chunk column while it is recomputed, as rows of 16 voxels along x indexed [y][z]
+struct SkyColumn
+{
+	ColumnCoord coord;
+	bool isQueued;
+	uint8x16 light[WorldHeight][ChunkDepth];
+
+	// All bits set for the voxels light passes through, the air of complete chunks
+	uint8x16 open[WorldHeight][ChunkDepth];
+
+	// Rows that can't get any brighter, every voxel is either solid or in direct sky light. Sweeps skip them
+	bool isSettled[WorldHeight][ChunkDepth];
+};
+
+// Sides of a chunk column whose border voxels got brighter
+constexpr uint32_t SkySideNegX = 1 << 0;
+constexpr uint32_t SkySidePosX = 1 << 1;
+constexpr uint32_t SkySideNegZ = 1 << 2;
+constexpr uint32_t SkySidePosZ = 1 << 3;
+
+// Light just outside the sides of a chunk column, it lights the border voxels of the column but isn't changed by it
+struct SkyBorders
+{
+	uint8_t negX[WorldHeight][ChunkDepth];
+	uint8_t posX[WorldHeight][ChunkDepth];
+	uint8x16 negZ[WorldHeight];
+	uint8x16 posZ[WorldHeight];
+};
+
+// Rows of a chunk column, from the column being recomputed if it is one, otherwise from its chunks
+struct SkyRowSource
+{
+	const SkyColumn* column;
+	const Chunk* chunks[WorldHeightChunks];
+};
+
+// Kept from one update to the next so they don't allocate again
+static std::vector<SkyColumn> g_skyColumns;
+static std::unordered_map<ColumnCoord, uint32_t, ColumnCoordHash> g_skyColumnIndices;
+static std::vector<uint32_t> g_skyColumnQueue;
+
+// Row of 16 voxels of a nibble array, one byte per voxel
+static uint8x16 loadNibbleRow(const uint8_t* nibbles, size_t rowIndex)
+{
+	uint8x16 packed = {};
+	memcpy(&packed, nibbles + rowIndex / 2, ChunkWidth / 2);
+
+	const uint8x16 spread = __builtin_shuffle(packed, uint8x16{ 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7 });
+	return (spread >> uint8x16{ 0, 4, 0, 4, 0, 4, 0, 4, 0, 4, 0, 4, 0, 4, 0, 4 }) & splat16(uint8_t(0xf));
+}
+
+static void storeNibbleRow(uint8_t* nibbles, size_t rowIndex, uint8x16 row)
+{
+	const uint8x16 low = __builtin_shuffle(row, uint8x16{ 0, 2, 4, 6, 8, 10, 12, 14, 0, 0, 0, 0, 0, 0, 0, 0 });
+	const uint8x16 high = __builtin_shuffle(row, uint8x16{ 1, 3, 5, 7, 9, 11, 13, 15, 0, 0, 0, 0, 0, 0, 0, 0 });
+	const uint8x16 packed = low | (high << 4);
+	memcpy(nibbles + rowIndex / 2, &packed, ChunkWidth / 2);
+}
+
+// Lanes whose voxel is set in a 16 bit row of occupancy bits
+static int8x16 expandRowBits(uint32_t bits)
+{
+	const uint8_t low = static_cast<uint8_t>(bits);
+	const uint8_t high = static_cast<uint8_t>(bits >> 8);
+	const uint8x16 bytes = { low, low, low, low, low, low, low, low, high, high, high, high, high, high, high, high };
+	return (bytes & uint8x16{ 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 }) != 0;
+}
+
+static uint8x16 max16(uint8x16 a, uint8x16 b)
+{
+	return a > b ? a : b;
+}
+
+// Light of the voxel towards -x of every lane, first is the light left of the row
+static uint8x16 getNegXNeighbours(uint8x16 row, uint8_t first)
+{
+	return __builtin_shuffle(row, splat16(first), uint8x16{ 16, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 });
+}
+
+// Light of the voxel towards +x of every lane, last is the light right of the row
+static uint8x16 getPosXNeighbours(uint8x16 row, uint8_t last)
+{
+	return __builtin_shuffle(row, splat16(last), uint8x16{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 });
+}
+
+static void initSkyRowSource(const World& world, const ColumnCoord& coord, SkyRowSource& outSource)
+{
+	auto it = g_skyColumnIndices.find(coord);
+	outSource.column = it != g_skyColumnIndices.end() ? &g_skyColumns[it->second] : nullptr;
+
+	for (int32_t chunkY = 0; chunkY < WorldHeightChunks; ++chunkY)
+	{
+		const Chunk* chunk = outSource.column ? nullptr : findChunk(world, { coord.x, chunkY, coord.z });
+		outSource.chunks[chunkY] = chunk && chunk->isComplete ? chunk : nullptr;
+	}
+}
+
+static uint8x16 getSkyRow(const SkyRowSource& source, int32_t y, size_t z)
+{
+	if (source.column)
+		return source.column->light[y][z];
+
+	const Chunk* chunk = source.chunks[y / ChunkHeight];
+	return chunk ? loadNibbleRow(chunk->skyLight, getVoxelIndex(0, y % ChunkHeight, z)) : splat16(uint8_t(0));
+}
+
+static void gatherSkyBorders(const World& world, const ColumnCoord& coord, SkyBorders& outBorders)
+{
+	SkyRowSource negX;
+	SkyRowSource posX;
+	SkyRowSource negZ;
+	SkyRowSource posZ;
+	initSkyRowSource(world, { coord.x - 1, coord.z }, negX);
+	initSkyRowSource(world, { coord.x + 1, coord.z }, posX);
+	initSkyRowSource(world, { coord.x, coord.z - 1 }, negZ);
+	initSkyRowSource(world, { coord.x, coord.z + 1 }, posZ);
+
+	for (int32_t y = 0; y < WorldHeight; ++y)
+	{
+		for (size_t z = 0; z < ChunkDepth; ++z)
+		{
+			outBorders.negX[y][z] = getSkyRow(negX, y, z)[ChunkWidth - 1];
+			outBorders.posX[y][z] = getSkyRow(posX, y, z)[0];
+		}
+		outBorders.negZ[y] = getSkyRow(negZ, y, ChunkDepth - 1);
+		outBorders.posZ[y] = getSkyRow(posZ, y, 0);
+	}
+}
+
+// Direct sky light above the highest solid block of every block column, and the voxels light can pass through
+static void resetSkyColumn(const World& world, const ChunkColumn& columnInfo, SkyColumn& column)
+{
+	int8x16 heights[ChunkDepth];
+	for (size_t z = 0; z < ChunkDepth; ++z)
+	{
+		for (size_t x = 0; x < ChunkWidth; ++x)
+		{
+			heights[z][x] = static_cast<int8_t>(columnInfo.columns[z][x].height);
+		}
+	}
+
+	const uint8x16 dark = splat16(uint8_t(0));
+	const uint8x16 lit = splat16(MaxLightLevel);
+
+	for (int32_t chunkY = 0; chunkY < WorldHeightChunks; ++chunkY)
+	{
+		const Chunk* chunk = findChunk(world, { column.coord.x, chunkY, column.coord.z });
+		const bool isComplete = chunk && chunk->isComplete;
+
+		for (size_t localY = 0; localY < ChunkHeight; ++localY)
+		{
+			const int32_t y = chunkY * static_cast<int32_t>(ChunkHeight) + static_cast<int32_t>(localY);
+			for (size_t z = 0; z < ChunkDepth; ++z)
+			{
+				if (!isComplete)
+				{
+					column.open[y][z] = dark;
+					column.light[y][z] = dark;
+					column.isSettled[y][z] = true;
+					continue;
+				}
+
+				const size_t rowIndex = getVoxelIndex(0, localY, z);
+				const uint32_t solidBits = static_cast<uint32_t>(chunk->occupancy.voxels[rowIndex / 64] >> (rowIndex % 64)) & 0xffff;
+				column.open[y][z] = expandRowBits(solidBits) ? dark : splat16(uint8_t(0xff));
+				column.light[y][z] = (splat16(static_cast<int8_t>(y)) > heights[z] ? lit : dark) & column.open[y][z];
+				column.isSettled[y][z] = !isAnyLaneSet(column.light[y][z] != (lit & column.open[y][z]));
+			}
+		}
+	}
+}
+
+// Spreads the light of the column one voxel per sweep until nothing changes, 16 voxels at a time. Sweeps alternate
+// between going up and going down and read the rows they already updated, so light runs a long way per sweep
+// along y and z. Returns the SkySide mask of the sides whose border voxels got brighter
+static uint32_t relaxSkyColumn(SkyColumn& column, const SkyBorders& borders)
+{
+	constexpr int32_t RowCount = WorldHeight * static_cast<int32_t>(ChunkDepth);
+	const uint8x16 one = splat16(uint8_t(1));
+	const uint8x16 dark = splat16(uint8_t(0));
+
+	uint32_t changedSides = 0;
+	for (int32_t sweep = 0; ; ++sweep)
+	{
+		bool isSweepChanged = false;
+		for (int32_t rowIt = 0; rowIt < RowCount; ++rowIt)
+		{
+			const int32_t row = sweep % 2 == 0 ? rowIt : RowCount - 1 - rowIt;
+			const int32_t y = row / static_cast<int32_t>(ChunkDepth);
+			const size_t z = row % ChunkDepth;
+			if (column.isSettled[y][z])
+				continue;
+
+			const uint8x16 light = column.light[y][z];
+			uint8x16 brightest = max16(getNegXNeighbours(light, borders.negX[y][z]), getPosXNeighbours(light, borders.posX[y][z]));
+			brightest = max16(brightest, z > 0 ? column.light[y][z - 1] : borders.negZ[y]);
+			brightest = max16(brightest, z < ChunkDepth - 1 ? column.light[y][z + 1] : borders.posZ[y]);
+			if (y > 0)
+			{
+				brightest = max16(brightest, column.light[y - 1][z]);
+			}
+			if (y < WorldHeight - 1)
+			{
+				brightest = max16(brightest, column.light[y + 1][z]);
+			}
+
+			const uint8x16 spread = max16(light, brightest - (brightest > dark ? one : dark)) & column.open[y][z];
+			const int8x16 isBrighter = spread != light;
+			if (!isAnyLaneSet(isBrighter))
+				continue;
+
+			column.light[y][z] = spread;
+			isSweepChanged = true;
+
+			changedSides |= (isBrighter[0] ? SkySideNegX : 0u) | (isBrighter[ChunkWidth - 1] ? SkySidePosX : 0u);
+			changedSides |= (z == 0 ? SkySideNegZ : 0u) | (z == ChunkDepth - 1 ? SkySidePosZ : 0u);
+		}
+
+		if (!isSweepChanged)
+			break;
+	}
+
+	return changedSides;
+}
+
+// Writes the light back into the chunks and marks the mesh sections where it changed dirty
+static void storeSkyColumn(World& world, const SkyColumn& column)
+{
+	for (int32_t chunkY = 0; chunkY < WorldHeightChunks; ++chunkY)
+	{
+		Chunk* chunk = findChunk(world, { column.coord.x, chunkY, column.coord.z });
+		if (!chunk || !chunk->isComplete)
+			continue;
+
+		const int32_t chunkMinY = chunkY * static_cast<int32_t>(ChunkHeight);
+		BlockBox changedBox = {};
+		bool isChanged = false;
+
+		for (size_t localY = 0; localY < ChunkHeight; ++localY)
+		{
+			for (size_t z = 0; z < ChunkDepth; ++z)
+			{
+				const size_t rowIndex = getVoxelIndex(0, localY, z);
+				const uint8x16 light = column.light[chunkMinY + localY][z];
+				if (!isAnyLaneSet(light != loadNibbleRow(chunk->skyLight, rowIndex)))
+					continue;
+
+				storeNibbleRow(chunk->skyLight, rowIndex, light);
+
+				const int32_t y = chunkMinY + static_cast<int32_t>(localY);
+				const int32_t blockZ = column.coord.z * static_cast<int32_t>(ChunkDepth) + static_cast<int32_t>(z);
+				if (!isChanged)
+				{
+					changedBox = { 0, y, blockZ, 0, y, blockZ };
+					isChanged = true;
+				}
+				changedBox.minY = std::min(changedBox.minY, y);
+				changedBox.minZ = std::min(changedBox.minZ, blockZ);
+				changedBox.maxY = std::max(changedBox.maxY, y);
+				changedBox.maxZ = std::max(changedBox.maxZ, blockZ);
+			}
+		}
+
+		if (isChanged)
+		{
+			changedBox.minX = column.coord.x * static_cast<int32_t>(ChunkWidth);
+			changedBox.maxX = changedBox.minX + static_cast<int32_t>(ChunkWidth) - 1;
+			markBoxDirty(world, changedBox);
+		}
+	}
+}
+
+void updateSkyLight(World& world)
+{
+	if (world.dirtySkyColumns.empty())
+		return;
+
+	ZoneScoped;
+
+	// Sky light reaches less than a chunk column into the next, a change can only affect the columns right around it
+	g_skyColumnIndices.clear();
+	for (const ColumnCoord& dirtyCoord : world.dirtySkyColumns)
+	{
+		for (int32_t offsetZ = -1; offsetZ <= 1; ++offsetZ)
+		{
+			for (int32_t offsetX = -1; offsetX <= 1; ++offsetX)
+			{
+				const ColumnCoord coord = { dirtyCoord.x + offsetX, dirtyCoord.z + offsetZ };
+				if (findColumn(world, coord))
+				{
+					g_skyColumnIndices.emplace(coord, static_cast<uint32_t>(g_skyColumnIndices.size()));
+				}
+			}
+		}
+	}
+	world.dirtySkyColumns.clear();
+
+	g_skyColumns.resize(g_skyColumnIndices.size());
+	g_skyColumnQueue.clear();
+	for (const auto& entry : g_skyColumnIndices)
+	{
+		SkyColumn& column = g_skyColumns[entry.second];
+		column.coord = entry.first;
+		column.isQueued = true;
+		resetSkyColumn(world, *findColumn(world, entry.first), column);
+		g_skyColumnQueue.push_back(entry.second);
+	}
+
+	// A column whose border got brighter can light up its neighbours, relax until none does
+	SkyBorders borders;
+	while (!g_skyColumnQueue.empty())
+	{
+		SkyColumn& column = g_skyColumns[g_skyColumnQueue.back()];
+		g_skyColumnQueue.pop_back();
+		column.isQueued = false;
+
+		gatherSkyBorders(world, column.coord, borders);
+		const uint32_t changedSides = relaxSkyColumn(column, borders);
+		if (changedSides == 0)
+			continue;
+
+		const ColumnCoord neighbourCoords[4] =
+		{
+			{ column.coord.x - 1, column.coord.z },
+			{ column.coord.x + 1, column.coord.z },
+			{ column.coord.x, column.coord.z - 1 },
+			{ column.coord.x, column.coord.z + 1 },
+		};
+		for (uint32_t side = 0; side < 4; ++side)
+		{
+			if ((changedSides & (1u << side)) == 0)
+				continue;
+
+			auto it = g_skyColumnIndices.find(neighbourCoords[side]);
+			if (it != g_skyColumnIndices.end() && !g_skyColumns[it->second].isQueued)
+			{
+				g_skyColumns[it->second].isQueued = true;
+				g_skyColumnQueue.push_back(it->second);
+			}
+		}
+	}
+
+	for (const SkyColumn& column : g_skyColumns)
+	{
+		storeSkyColumn(world, column);
+	}
+}
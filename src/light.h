@@ -0,0 +1,64 @@
+#pragma once
+
+#include "chunk.h"
+#include "world.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Block light spreads from emitting blocks through air, one level less with every block, and stops at solid
+// blocks. It crosses into every complete chunk, incomplete chunks stay dark until they complete.
+
+inline uint8_t getBlockLight(const Chunk& chunk, size_t voxelIndex)
+{
+	return (chunk.blockLight[voxelIndex / 2] >> ((voxelIndex % 2) * 4)) & 0xf;
+}
+
+inline void setBlockLight(Chunk& chunk, size_t voxelIndex, uint8_t level)
+{
+	const uint32_t shift = (voxelIndex % 2) * 4;
+	uint8_t& pair = chunk.blockLight[voxelIndex / 2];
+	pair = static_cast<uint8_t>((pair & ~(0xf << shift)) | (level << shift));
+}
+
+// Sky light fills the air above the highest solid block of every block column with MaxLightLevel and spreads
+// from there like block light, under overhangs and into caves. Completed chunks mark their chunk column to be
+// computed as a whole from the column info, edits relight only as far as they reach.
+inline uint8_t getSkyLight(const Chunk& chunk, size_t voxelIndex)
+{
+	return (chunk.skyLight[voxelIndex / 2] >> ((voxelIndex % 2) * 4)) & 0xf;
+}
+
+inline void setSkyLight(Chunk& chunk, size_t voxelIndex, uint8_t level)
+{
+	const uint32_t shift = (voxelIndex % 2) * 4;
+	uint8_t& pair = chunk.skyLight[voxelIndex / 2];
+	pair = static_cast<uint8_t>((pair & ~(0xf << shift)) | (level << shift));
+}
+
+// Lights a chunk that just completed from its own emitters and from the light of the complete chunks around it,
+// and marks its chunk column for sky light. Main thread only, the occupancy of the chunk must be up to date
+void initChunkLight(World& world, Chunk& chunk);
+
+// Relights the world after the blocks of voxels of a complete chunk changed, only as far as the changes reach: the
+// light the old blocks let through or gave off is taken out, then the light around them spreads in again. One pass
+// covers all the voxels. Marks the mesh sections whose light changed dirty. Main thread only, the blocks and the
+// occupancy must already be updated
+void updateBlockLight(World& world, Chunk& chunk, const uint16_t* voxelIndices, size_t voxelCount);
+
+// Marks the chunk column of a chunk for updateSkyLight()
+void markSkyLightDirty(World& world, const Chunk& chunk);
+
+// Whether a change of the block of a voxel can change sky light, asked before relighting. It can't where the voxel
+// and all its neighbours are dark, which covers most edits underground. A change of the highest solid block of a
+// column always can, the air above it is lit
+bool canChangeSkyLight(const World& world, Chunk& chunk, size_t voxelIndex);
+
+// Relights the sky light after the blocks of voxels of a complete chunk changed, like updateBlockLight(). The air
+// of their block columns that lost direct sky light is taken out, then the air that gained it and the light around
+// the voxels spread in again. Main thread only, the occupancy and the column info must already be updated
+void updateSkyLight(World& world, Chunk& chunk, const uint16_t* voxelIndices, size_t voxelCount);
+
+// Recomputes the sky light of the marked chunk columns and of the ones around them, sky light reaches less than
+// a chunk column into its neighbours. Marks the mesh sections whose light changed dirty. Main thread only
+void updateSkyLight(World& world);
@@ -0,0 +1,4 @@
+// The LZ4 bundled with Tracy, TracyClient.cpp only builds it along with the profiler
+#ifndef TRACY_ENABLE
+#include "tracy/common/tracy_lz4.cpp"
+#endif
@@ -1,7 +1,15 @@
 #define GLM_ENABLE_EXPERIMENTAL
 
 #include "renderer/renderer.h"
+#include "block.h"
 #include "chunk.h"
+#include "collision.h"
+#include "editlog.h"
+#include "light.h"
+#include "raycast.h"
+#include "storage.h"
+#include "world.h"
+#include "worldgen/pipeline.h"
 #include "nxlink.h"
 
 #include <glm/mat4x4.hpp>
@@ -14,10 +22,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <chrono>
+
 #include <switch.h>
 
 #include "tracy/Tracy.hpp"
 
+constexpr const char* WorldDirectory = "sdmc:/switch/voxelgame/worlds";
+constexpr const char* ChunkCacheDirectory = "sdmc:/switch/voxelgame/chunkcache";
+constexpr uint64_t ChunkCacheMaxBytes = 64 * 1024 * 1024;
+
+// Chunks not accessed for this long are compressed in memory, a few per frame at most out of a slice of the chunks
+constexpr uint32_t ColdChunkSeconds = 30;
+constexpr size_t ColdChunksPerFrame = 4;
+constexpr size_t ColdChunkScansPerFrame = 64;
+
+// Blocks further away than this can't be picked for editing
+constexpr float PickDistance = 8.0f;
+
+// The camera is the eye of a player sized box that slides along the blocks it runs into
+constexpr float PlayerHalfWidth = 0.3f;
+constexpr float PlayerHeight = 1.8f;
+constexpr float PlayerEyeHeight = 1.6f;
+
 int main(int argc, char* argv[])
 {
 	initNxLink();
@@ -42,29 +69,59 @@ int main(int argc, char* argv[])
 
 	GLuint shaderProgram = loadShaderProgram("romfs:/shaders/chunk.vs", "romfs:/shaders/chunk.fs");
 
-	std::vector<Chunk> chunks;
+	const uint32_t worldSeed = 1337;
+
+	World world;
+	initWorld(world, worldSeed);
+
+	CWorldStorage worldStorage;
+	const bool isWorldStorageEnabled = worldStorage.Init(WorldDirectory, worldSeed);
+
+	// Edits are saved through the log, it replays what a crash left behind
+	CEditLog editLog;
+	if (isWorldStorageEnabled && editLog.Init(&worldStorage))
+	{
+		world.editLog = &editLog;
+	}
+
+	// Generating a chunk costs a lot more than reading it back from the SD card
+	CChunkCache chunkCache;
+	const bool isChunkCacheEnabled = chunkCache.Init(ChunkCacheDirectory, ChunkCacheMaxBytes);
+
+	// Core 0 stays with the main thread, the application gets cores 1 and 2 as well
+	CWorldGenPipeline worldGen;
+	if (!worldGen.Init(&world, 2, isWorldStorageEnabled ? &worldStorage : nullptr, isChunkCacheEnabled ? &chunkCache : nullptr))
+	{
+		TRACE("Could not start world generation");
+		return EXIT_FAILURE;
+	}
+
 	std::vector<VisualChunk> visualChunks;
+	std::unordered_map<ChunkCoord, size_t, ChunkCoordHash> visualChunkIndices;
+	std::vector<Chunk*> completedChunks;
 
+	uint32_t requestedChunkCount = 0;
 	for (int32_t x = -2; x < 2; ++x)
 	{
-		for (int32_t z = -2; z < 2; ++z)
+		for (int32_t y = 0; y < 4; ++y)
 		{
-			Chunk chunk;
-			initChunk(chunk, x, 0, z);
-
-			VisualChunk visualChunk;
-			initVisualChunk(visualChunk, chunk);
-
-			chunks.push_back(chunk);
-			visualChunks.push_back(visualChunk);
+			for (int32_t z = -2; z < 2; ++z)
+			{
+				worldGen.Request({ x, y, z });
+				++requestedChunkCount;
+			}
 		}
 	}
 
+	const auto generationStart = std::chrono::steady_clock::now();
+
+	std::vector<const VisualChunk*> drawList;
+
 	float t = 0.0f;
 
 	float cameraYaw = 0.0f;
 	float cameraPitch = 0.0f;
-	glm::vec3 cameraPos(0.0f);
+	glm::vec3 cameraPos(0.0f, 56.0f, 0.0f);
 
 	float movementSpeed = 0.5f;
 	float lookSpeed = 0.07f;
@@ -74,6 +131,47 @@ int main(int argc, char* argv[])
 	{
 		t += 0.001f;
 
+		const std::chrono::duration<double> runTime = std::chrono::steady_clock::now() - generationStart;
+		BlockStorage::setAccessTime(static_cast<uint32_t>(runTime.count()));
+
+		// Mesh the chunks the world generation finished
+		completedChunks.clear();
+		worldGen.Update(completedChunks);
+		for (Chunk* chunk : completedChunks)
+		{
+			if (world.editLog)
+			{
+				world.editLog->ApplyReplayedEdits(world, *chunk);
+			}
+			initChunkLight(world, *chunk);
+
+			// The meshes around the new chunk kept their faces towards it, they are culled against it now
+			const int32_t chunkX = chunk->x * static_cast<int32_t>(ChunkWidth);
+			const int32_t chunkY = chunk->y * static_cast<int32_t>(ChunkHeight);
+			const int32_t chunkZ = chunk->z * static_cast<int32_t>(ChunkDepth);
+			markBoxDirty(world, { chunkX, chunkY, chunkZ,
+				chunkX + static_cast<int32_t>(ChunkWidth) - 1, chunkY + static_cast<int32_t>(ChunkHeight) - 1, chunkZ + static_cast<int32_t>(ChunkDepth) - 1 });
+		}
+
+		// Light the new chunks before their first mesh, that mesh is up to date so they aren't remeshed this frame
+		updateSkyLight(world);
+		for (Chunk* chunk : completedChunks)
+		{
+			const ChunkCoord coord = { chunk->x, chunk->y, chunk->z };
+
+			VisualChunk visualChunk;
+			initVisualChunk(visualChunk, world, *chunk);
+			visualChunkIndices[coord] = visualChunks.size();
+			visualChunks.push_back(visualChunk);
+			world.dirtyChunks.erase(coord);
+
+			if (visualChunks.size() == requestedChunkCount)
+			{
+				const std::chrono::duration<double> generationTime = std::chrono::steady_clock::now() - generationStart;
+				printf("Generated %u chunks in %.2f ms (%.0f chunks/sec)\n", requestedChunkCount, generationTime.count() * 1000.0, requestedChunkCount / generationTime.count());
+			}
+		}
+
 		// Get and process input
 		hidScanInput();
 		u32 kDown = hidKeysDown(CONTROLLER_P1_AUTO);
@@ -93,6 +191,14 @@ int main(int argc, char* argv[])
 			VisualChunk::s_freezeCulling = !VisualChunk::s_freezeCulling;
 		}
 
+		if (kDown & KEY_X)
+		{
+			const BlockStorageStats stats = BlockStorage::getStats();
+			printf("Cold chunks: %u compressed, %.1f KB -> %.1f KB (%.1fx), hit rate %.1f%%\n", stats.compressedCount,
+				stats.uncompressedBytes / 1024.0, stats.compressedBytes / 1024.0, stats.compressedBytes > 0 ? static_cast<double>(stats.uncompressedBytes) / stats.compressedBytes : 0.0,
+				stats.accessCount > 0 ? 100.0 * (stats.accessCount - stats.missCount) / stats.accessCount : 100.0);
+		}
+
 		// Read joysticks
 		JoystickPosition joyLeft, joyRight;
         hidJoystickRead(&joyLeft, CONTROLLER_P1_AUTO, JOYSTICK_LEFT);
@@ -108,25 +214,61 @@ int main(int argc, char* argv[])
 		cameraPitch = std::min(cameraPitch, glm::half_pi<float>());
 		cameraPitch = std::max(cameraPitch, -glm::half_pi<float>());
 
-		cameraPos.x += (moveForward * sin(cameraYaw) * cos(cameraPitch) + moveRight * cos(cameraYaw)) * movementSpeed;
-		cameraPos.z += (moveForward * cos(cameraYaw) * cos(cameraPitch) + moveRight * -sin(cameraYaw)) * movementSpeed;
-		cameraPos.y -= moveForward * sin(cameraPitch) * movementSpeed;
+		const glm::vec3 cameraMotion(
+			(moveForward * sin(cameraYaw) * cos(cameraPitch) + moveRight * cos(cameraYaw)) * movementSpeed,
+			-moveForward * sin(cameraPitch) * movementSpeed,
+			(moveForward * cos(cameraYaw) * cos(cameraPitch) + moveRight * -sin(cameraYaw)) * movementSpeed);
+
+		const glm::vec3 eyeOffset(PlayerHalfWidth, PlayerEyeHeight, PlayerHalfWidth);
+		Aabb playerBox = { cameraPos - eyeOffset, cameraPos - eyeOffset + glm::vec3(2.0f * PlayerHalfWidth, PlayerHeight, 2.0f * PlayerHalfWidth) };
+		moveAabb(world, playerBox, cameraMotion);
+		cameraPos = playerBox.min + eyeOffset;
 
 		glm::mat4 cameraMatrix = glm::translate(glm::mat4(1.0f), cameraPos) * glm::eulerAngleYX(cameraYaw, cameraPitch);
 
+		// Pick the block in the middle of the screen, ZR breaks it, ZL places stone and Y a lamp against the face the camera sees
+		RaycastHit pickedBlock;
+		if (raycastBlocks(world, cameraPos, glm::vec3(cameraMatrix[2]), PickDistance, pickedBlock))
+		{
+			if (kDown & KEY_ZR)
+			{
+				setBlock(world, pickedBlock.x, pickedBlock.y, pickedBlock.z, BlockAir);
+			}
+			else if ((kDown & (KEY_ZL | KEY_Y)) && pickedBlock.face != FaceDirectionCount)
+			{
+				const glm::ivec3 normal = getFaceNormal(pickedBlock.face);
+				setBlock(world, pickedBlock.x + normal.x, pickedBlock.y + normal.y, pickedBlock.z + normal.z, (kDown & KEY_ZL) ? BlockStone : BlockLamp);
+			}
+		}
+
 		glm::mat4 matView = glm::inverse(cameraMatrix);
 		glm::mat4 matProj = glm::perspectiveFovLH(glm::radians(80.0f), 1280.0f, 720.0f, 0.1f, 1000.0f);
 
 		glm::mat4 matViewProj = matProj * matView;
 
+		// Remesh the sections this frame's edits changed, each only once
+		updateSkyLight(world);
+		for (const auto& entry : world.dirtyChunks)
+		{
+			auto it = visualChunkIndices.find(entry.first);
+			const Chunk* chunk = findChunk(world, entry.first);
+			if (it != visualChunkIndices.end() && chunk)
+			{
+				updateVisualChunk(visualChunks[it->second], world, *chunk, entry.second);
+			}
+		}
+		world.dirtyChunks.clear();
+
 		CullChunkParams cullParams;
 		cullParams.matViewProj = matViewProj;
+		cullParams.cameraPos = cameraPos;
+
+		VisualChunk::beginFrame();
 
 		// Cull chunks
-		for (const VisualChunk& visualChunk : visualChunks)
-		{
-			cullChunk(visualChunk, cullParams);
-		}
+		cullChunks(visualChunks, cullParams, drawList);
+
+		VisualChunk::syncCulling();
 
 		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 		glClearDepth(1.0f);
@@ -144,9 +286,9 @@ int main(int argc, char* argv[])
 		glDisable(GL_BLEND);
 		glDepthMask(GL_TRUE);
 
-		for (const VisualChunk& visualChunk : visualChunks)
+		for (const VisualChunk* visualChunk : drawList)
 		{
-			drawChunkOpaque(visualChunk);
+			drawChunkOpaque(*visualChunk);
 		}
 
 		// Draw transparency
@@ -157,12 +299,42 @@ int main(int argc, char* argv[])
 
 		//drawChunkTransparent(visualChunk);
 
+		VisualChunk::endFrame();
+
+		compressColdChunks(world, ColdChunkSeconds, ColdChunksPerFrame, ColdChunkScansPerFrame);
+
+		// Save this frame's edits
+		if (world.editLog)
+		{
+			world.editLog->Flush();
+			world.editLog->Update(world);
+		}
+
 		// Render stuff!
 		renderer->Render();
 		renderer->Present();
 		FrameMark;
 	}
 
+	worldGen.Deinit();
+
+	if (world.editLog)
+	{
+		world.editLog->Deinit(world);
+		world.editLog = nullptr;
+	}
+
+	if (isWorldStorageEnabled)
+	{
+		worldStorage.Deinit();
+	}
+
+	if (isChunkCacheEnabled)
+	{
+		chunkCache.Deinit();
+	}
+	deinitWorld(world);
+
 	glDeleteProgram(shaderProgram);
 
 	VisualChunk::deinit();
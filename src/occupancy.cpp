@@ -0,0 +1,113 @@
+#include "occupancy.h"
+#include "block.h"
+
+#include <string.h>
+
+#include "tracy/Tracy.hpp"
+
+// A word holds 4 rows of 16 voxels, the bits of one brick in it are 4 bits of each row
+constexpr uint64_t BrickRowsMask = 0x000f000f000f000full;
+
+static_assert(ChunkWidth == 16 && ChunkBrickSize == 4, "The brick mask assumes 16 voxel rows and 4 voxel bricks");
+static_assert(ChunkWidth == ChunkHeight && ChunkHeight == ChunkDepth, "The transposed copies assume cubic chunks");
+
+static void toggleTransposedBits(ChunkOccupancy& occupancy, size_t voxelIndex)
+{
+	const size_t x = voxelIndex % ChunkWidth;
+	const size_t y = (voxelIndex / ChunkWidth) % ChunkHeight;
+	const size_t z = (voxelIndex / ChunkWidth) / ChunkHeight;
+
+	const size_t indexY = getVoxelIndexY(x, y, z);
+	const size_t indexZ = getVoxelIndexZ(x, y, z);
+	occupancy.voxelsY[indexY / 64] ^= uint64_t(1) << (indexY % 64);
+	occupancy.voxelsZ[indexZ / 64] ^= uint64_t(1) << (indexZ % 64);
+}
+
+static bool isBrickSolid(const ChunkOccupancy& occupancy, size_t brickX, size_t brickY, size_t brickZ)
+{
+	const uint64_t mask = BrickRowsMask << (brickX * ChunkBrickSize);
+
+	uint64_t solid = 0;
+	for (size_t z = brickZ * ChunkBrickSize; z < (brickZ + 1) * ChunkBrickSize; ++z)
+	{
+		solid |= occupancy.voxels[getVoxelIndex(0, brickY * ChunkBrickSize, z) / 64] & mask;
+	}
+	return solid != 0;
+}
+
+void updateChunkOccupancy(Chunk& chunk)
+{
+	ZoneScoped;
+
+	ChunkOccupancy& occupancy = chunk.occupancy;
+	const uint32_t* blocks = static_cast<const Chunk&>(chunk).blocks.data();
+
+	occupancy.solidCount = 0;
+	for (size_t wordIt = 0; wordIt < ChunkVoxelCount / 64; ++wordIt)
+	{
+		uint64_t word = 0;
+		for (size_t bit = 0; bit < 64; ++bit)
+		{
+			word |= uint64_t(isSolidBlock(blocks[wordIt * 64 + bit])) << bit;
+		}
+		occupancy.voxels[wordIt] = word;
+		occupancy.solidCount += static_cast<uint32_t>(__builtin_popcountll(word));
+	}
+
+	memset(occupancy.voxelsY, 0, sizeof(occupancy.voxelsY));
+	memset(occupancy.voxelsZ, 0, sizeof(occupancy.voxelsZ));
+	for (size_t wordIt = 0; wordIt < ChunkVoxelCount / 64; ++wordIt)
+	{
+		for (uint64_t word = occupancy.voxels[wordIt]; word != 0; word &= word - 1)
+		{
+			toggleTransposedBits(occupancy, wordIt * 64 + __builtin_ctzll(word));
+		}
+	}
+
+	occupancy.bricks = 0;
+	for (size_t brickZ = 0; brickZ < ChunkDepth / ChunkBrickSize; ++brickZ)
+	{
+		for (size_t brickY = 0; brickY < ChunkHeight / ChunkBrickSize; ++brickY)
+		{
+			for (size_t brickX = 0; brickX < ChunkWidth / ChunkBrickSize; ++brickX)
+			{
+				if (isBrickSolid(occupancy, brickX, brickY, brickZ))
+				{
+					occupancy.bricks |= uint64_t(1) << getBrickIndex(brickX * ChunkBrickSize, brickY * ChunkBrickSize, brickZ * ChunkBrickSize);
+				}
+			}
+		}
+	}
+}
+
+void updateVoxelOccupancy(Chunk& chunk, size_t voxelIndex, uint32_t block)
+{
+	ChunkOccupancy& occupancy = chunk.occupancy;
+
+	const bool isSolid = isSolidBlock(block);
+	if (isVoxelOccupied(occupancy, voxelIndex) == isSolid)
+		return;
+
+	occupancy.voxels[voxelIndex / 64] ^= uint64_t(1) << (voxelIndex % 64);
+	toggleTransposedBits(occupancy, voxelIndex);
+
+	const size_t x = voxelIndex % ChunkWidth;
+	const size_t y = (voxelIndex / ChunkWidth) % ChunkHeight;
+	const size_t z = (voxelIndex / ChunkWidth) / ChunkHeight;
+	const uint64_t brickBit = uint64_t(1) << getBrickIndex(x, y, z);
+
+	if (isSolid)
+	{
+		++occupancy.solidCount;
+		occupancy.bricks |= brickBit;
+	}
+	else
+	{
+		// The brick stays occupied while any other voxel of it is solid
+		--occupancy.solidCount;
+		if (!isBrickSolid(occupancy, x / ChunkBrickSize, y / ChunkBrickSize, z / ChunkBrickSize))
+		{
+			occupancy.bricks &= ~brickBit;
+		}
+	}
+}
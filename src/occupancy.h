@@ -0,0 +1,42 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Brick of the voxel at local coordinates, bricks are stored in the same x, y, z order as voxels
+inline size_t getBrickIndex(size_t x, size_t y, size_t z)
+{
+	constexpr size_t BricksPerRow = ChunkWidth / ChunkBrickSize;
+	constexpr size_t BricksPerLayer = ChunkHeight / ChunkBrickSize;
+	return x / ChunkBrickSize + BricksPerRow * (y / ChunkBrickSize + BricksPerLayer * (z / ChunkBrickSize));
+}
+
+// Index of the voxel at local coordinates in ChunkOccupancy::voxelsY, y first, then x, then z
+inline size_t getVoxelIndexY(size_t x, size_t y, size_t z)
+{
+	return y + ChunkHeight * (x + ChunkWidth * z);
+}
+
+// Index of the voxel at local coordinates in ChunkOccupancy::voxelsZ, z first, then x, then y
+inline size_t getVoxelIndexZ(size_t x, size_t y, size_t z)
+{
+	return z + ChunkDepth * (x + ChunkWidth * y);
+}
+
+inline bool isVoxelOccupied(const ChunkOccupancy& occupancy, size_t voxelIndex)
+{
+	return (occupancy.voxels[voxelIndex / 64] >> (voxelIndex % 64)) & 1;
+}
+
+inline bool isBrickOccupied(const ChunkOccupancy& occupancy, size_t brickIndex)
+{
+	return (occupancy.bricks >> brickIndex) & 1;
+}
+
+// Rebuilds the occupancy from the blocks of the chunk
+void updateChunkOccupancy(Chunk& chunk);
+
+// Keeps the occupancy in sync after the block of a voxel changed
+void updateVoxelOccupancy(Chunk& chunk, size_t voxelIndex, uint32_t block);
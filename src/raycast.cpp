@@ -0,0 +1,175 @@
+#include "raycast.h"
+#include "occupancy.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#include "tracy/Tracy.hpp"
+
+// Face the ray enters a block through when it steps into it along axis
+static FaceDirection getEnteredFace(int32_t axis, int32_t step)
+{
+	static const FaceDirection negativeFaces[3] = { FaceNegX, FaceNegY, FaceNegZ };
+	return static_cast<FaceDirection>(negativeFaces[axis] + (step < 0 ? 1 : 0));
+}
+
+static int32_t floorToCell(int32_t coord, int32_t cellSize)
+{
+	return (coord >= 0 ? coord : coord - cellSize + 1) / cellSize * cellSize;
+}
+
+bool raycastBlocks(const World& world, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RaycastHit& outHit)
+{
+	ZoneScoped;
+
+	const float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+	if (length <= 0.0f)
+		return false;
+
+	const glm::vec3 rayDirection = direction / length;
+
+	// Amanatides and Woo: tMax is the distance to the next block boundary on each axis, tDelta the distance between two
+	int32_t voxel[3];
+	int32_t step[3];
+	float tMax[3];
+	float tDelta[3];
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		voxel[axis] = static_cast<int32_t>(floorf(origin[axis]));
+
+		if (rayDirection[axis] > 0.0f)
+		{
+			step[axis] = 1;
+			tDelta[axis] = 1.0f / rayDirection[axis];
+			tMax[axis] = (static_cast<float>(voxel[axis] + 1) - origin[axis]) * tDelta[axis];
+		}
+		else if (rayDirection[axis] < 0.0f)
+		{
+			step[axis] = -1;
+			tDelta[axis] = -1.0f / rayDirection[axis];
+			tMax[axis] = (origin[axis] - static_cast<float>(voxel[axis])) * tDelta[axis];
+		}
+		else
+		{
+			step[axis] = 0;
+			tDelta[axis] = FLT_MAX;
+			tMax[axis] = FLT_MAX;
+		}
+	}
+
+	const int32_t chunkSizes[3] = { static_cast<int32_t>(ChunkWidth), static_cast<int32_t>(ChunkHeight), static_cast<int32_t>(ChunkDepth) };
+
+	ChunkCoord chunkCoord = { 0, 0, 0 };
+	const Chunk* chunk = nullptr;
+	bool hasChunkCoord = false;
+
+	int32_t enteredAxis = -1;
+	float distance = 0.0f;
+
+	while (distance <= maxDistance)
+	{
+		const ChunkCoord voxelChunkCoord = { getChunkCoord(voxel[0], ChunkWidth), getChunkCoord(voxel[1], ChunkHeight), getChunkCoord(voxel[2], ChunkDepth) };
+		if (!hasChunkCoord || voxelChunkCoord != chunkCoord)
+		{
+			chunkCoord = voxelChunkCoord;
+			hasChunkCoord = true;
+
+			chunk = findChunk(world, chunkCoord);
+			if (chunk && !chunk->isComplete)
+			{
+				chunk = nullptr;
+			}
+		}
+
+		// Size of the empty cell around the voxel the ray can cross at once, zero to step a single voxel
+		int32_t cellSizes[3] = { 0, 0, 0 };
+		if (!chunk || chunk->occupancy.solidCount == 0)
+		{
+			cellSizes[0] = chunkSizes[0];
+			cellSizes[1] = chunkSizes[1];
+			cellSizes[2] = chunkSizes[2];
+		}
+		else
+		{
+			const size_t localX = static_cast<size_t>(voxel[0] - chunkCoord.x * chunkSizes[0]);
+			const size_t localY = static_cast<size_t>(voxel[1] - chunkCoord.y * chunkSizes[1]);
+			const size_t localZ = static_cast<size_t>(voxel[2] - chunkCoord.z * chunkSizes[2]);
+
+			if (!isBrickOccupied(chunk->occupancy, getBrickIndex(localX, localY, localZ)))
+			{
+				cellSizes[0] = cellSizes[1] = cellSizes[2] = static_cast<int32_t>(ChunkBrickSize);
+			}
+			else
+			{
+				const size_t voxelIndex = getVoxelIndex(localX, localY, localZ);
+				if (isVoxelOccupied(chunk->occupancy, voxelIndex))
+				{
+					outHit.x = voxel[0];
+					outHit.y = voxel[1];
+					outHit.z = voxel[2];
+					outHit.block = chunk->blocks[voxelIndex];
+					outHit.face = enteredAxis >= 0 ? getEnteredFace(enteredAxis, step[enteredAxis]) : FaceDirectionCount;
+					outHit.distance = distance;
+					return true;
+				}
+			}
+		}
+
+		if (cellSizes[0] == 0)
+		{
+			int32_t axis = tMax[0] < tMax[1] ? 0 : 1;
+			axis = tMax[2] < tMax[axis] ? 2 : axis;
+
+			distance = tMax[axis];
+			voxel[axis] += step[axis];
+			tMax[axis] += tDelta[axis];
+			enteredAxis = axis;
+			continue;
+		}
+
+		// Leave the empty cell through the first boundary the ray reaches
+		int32_t cellMin[3];
+		int32_t exitAxis = -1;
+		float exitDistance = FLT_MAX;
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			cellMin[axis] = floorToCell(voxel[axis], cellSizes[axis]);
+			if (step[axis] == 0)
+				continue;
+
+			const int32_t boundary = step[axis] > 0 ? cellMin[axis] + cellSizes[axis] : cellMin[axis];
+			const float axisDistance = (static_cast<float>(boundary) - origin[axis]) / rayDirection[axis];
+			if (axisDistance < exitDistance)
+			{
+				exitDistance = axisDistance;
+				exitAxis = axis;
+			}
+		}
+
+		// Restart the walk from the voxel across the boundary, the other axes are clamped into the
+		// cell so rounding can't move the ray back or skip a voxel next to the cell
+		distance = exitDistance;
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			if (axis == exitAxis)
+			{
+				voxel[axis] = step[axis] > 0 ? cellMin[axis] + cellSizes[axis] : cellMin[axis] - 1;
+			}
+			else
+			{
+				const int32_t coord = static_cast<int32_t>(floorf(origin[axis] + rayDirection[axis] * distance));
+				voxel[axis] = std::min(std::max(coord, cellMin[axis]), cellMin[axis] + cellSizes[axis] - 1);
+			}
+
+			if (step[axis] != 0)
+			{
+				const int32_t boundary = step[axis] > 0 ? voxel[axis] + 1 : voxel[axis];
+				tMax[axis] = (static_cast<float>(boundary) - origin[axis]) / rayDirection[axis];
+			}
+		}
+		enteredAxis = exitAxis;
+	}
+
+	return false;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "chunk.h"
+#include "world.h"
+
+#include <stdint.h>
+
+#include <glm/vec3.hpp>
+
+struct RaycastHit
+{
+	// World coordinates of the solid block the ray hit
+	int32_t x;
+	int32_t y;
+	int32_t z;
+	uint32_t block;
+
+	// Face the ray entered the block through, FaceDirectionCount when the ray started inside it
+	FaceDirection face;
+
+	// Distance along the ray to where it entered the block
+	float distance;
+};
+
+// Walks the blocks along the ray until the first solid one within maxDistance, false if there is none.
+// Empty and missing chunks as well as empty bricks of a chunk are crossed in a single step, the voxels
+// of occupied bricks are tested against the occupancy bits without touching the blocks.
+// Only sees complete chunks, main thread only
+bool raycastBlocks(const World& world, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RaycastHit& outHit);
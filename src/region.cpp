@@ -0,0 +1,502 @@
+#include "region.h"
+#include "chunk.h"
+#include "filesystem.h"
+#include "nxlink.h"
+#include "worldgen/worldgen.h"
+
+#include "tracy/Tracy.hpp"
+#include "tracy/common/tracy_lz4.hpp"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef __SWITCH__
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+
+constexpr uint32_t RegionFileMagic = 0x4e475252; // "RRGN"
+constexpr uint32_t RegionFileVersion = 3;
+
+constexpr size_t RegionTableOffset = sizeof(RegionFileHeader);
+constexpr size_t RegionDataOffset = RegionTableOffset + RegionChunkCount * sizeof(RegionChunkSlot);
+
+static bool isFile(const std::string& path)
+{
+	struct stat fileStat;
+	return stat(path.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+}
+
+// Region files only get their magic once they have been written completely, see CRegionWriter::End()
+static bool isCompleteRegionFile(const std::string& path, int32_t regionX, int32_t regionZ)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	RegionFileHeader header;
+	const bool hasHeader = fread(&header, sizeof(header), 1, file) == 1;
+	fclose(file);
+
+	return hasHeader && header.magic == RegionFileMagic && header.version == RegionFileVersion && header.regionX == regionX && header.regionZ == regionZ;
+}
+
+// rename() replaces an existing file in one step on POSIX but fails on the Switch. There the old file is moved
+// aside to a .bak first and only removed once the new one is in place. The new file is kept on failure
+static bool replaceFile(const std::string& newPath, const std::string& path)
+{
+	if (rename(newPath.c_str(), path.c_str()) == 0)
+		return true;
+
+	const std::string backupPath = path + ".bak";
+	remove(backupPath.c_str());
+	const bool hasBackup = rename(path.c_str(), backupPath.c_str()) == 0;
+
+	if (rename(newPath.c_str(), path.c_str()) != 0)
+	{
+		if (hasBackup)
+		{
+			rename(backupPath.c_str(), path.c_str());
+		}
+		return false;
+	}
+
+	if (hasBackup)
+	{
+		remove(backupPath.c_str());
+	}
+	return true;
+}
+
+// Puts back what an interrupted CRegionWriter::End() left behind. A complete temp file is newer than the region
+// file, a backup is only used when the region file itself is gone
+static void recoverRegionFile(const std::string& path, int32_t regionX, int32_t regionZ)
+{
+	const std::string tempPath = path + ".tmp";
+	if (isFile(tempPath) && isCompleteRegionFile(tempPath, regionX, regionZ))
+	{
+		TRACE("Recovering region file %s", tempPath.c_str());
+		replaceFile(tempPath, path);
+		syncParentDirectory(path);
+	}
+
+	const std::string backupPath = path + ".bak";
+	if (!isFile(backupPath))
+		return;
+
+	if (isFile(path))
+	{
+		remove(backupPath.c_str());
+	}
+	else
+	{
+		TRACE("Recovering region file %s", backupPath.c_str());
+		rename(backupPath.c_str(), path.c_str());
+		syncParentDirectory(path);
+	}
+}
+
+static void encodeFullChunk(const ChunkSnapshot& chunk, std::vector<uint8_t>& outBlob)
+{
+	std::vector<uint32_t> palette(chunk.blocks.begin(), chunk.blocks.end());
+	std::sort(palette.begin(), palette.end());
+	palette.erase(std::unique(palette.begin(), palette.end()), palette.end());
+
+	const size_t indexSize = palette.size() <= 256 ? 1 : 2;
+
+	uint8_t indices[ChunkVoxelCount * 2];
+	uint32_t lastBlock = palette[0];
+	uint16_t lastIndex = 0;
+	for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; ++voxelIt)
+	{
+		const uint32_t block = chunk.blocks[voxelIt];
+		if (block != lastBlock)
+		{
+			lastBlock = block;
+			lastIndex = static_cast<uint16_t>(std::lower_bound(palette.begin(), palette.end(), block) - palette.begin());
+		}
+
+		if (indexSize == 1)
+		{
+			indices[voxelIt] = static_cast<uint8_t>(lastIndex);
+		}
+		else
+		{
+			memcpy(&indices[voxelIt * 2], &lastIndex, sizeof(lastIndex));
+		}
+	}
+
+	const int indicesSize = static_cast<int>(ChunkVoxelCount * indexSize);
+	const size_t paletteBytes = palette.size() * sizeof(uint32_t);
+	const size_t dataOffset = sizeof(RegionChunkHeader) + paletteBytes;
+
+	outBlob.resize(dataOffset + tracy::LZ4_compressBound(indicesSize));
+	const int compressedSize = tracy::LZ4_compress_default(reinterpret_cast<const char*>(indices), reinterpret_cast<char*>(&outBlob[dataOffset]), indicesSize, static_cast<int>(outBlob.size() - dataOffset));
+
+	RegionChunkHeader header;
+	header.kind = RegionChunkFull;
+	header.indexSize = static_cast<uint8_t>(indexSize);
+	header.paletteSize = static_cast<uint16_t>(palette.size());
+	header.dataSize = static_cast<uint32_t>(compressedSize);
+	memcpy(&outBlob[0], &header, sizeof(header));
+	memcpy(&outBlob[sizeof(header)], palette.data(), paletteBytes);
+
+	outBlob.resize(dataOffset + compressedSize);
+}
+
+static bool decodeFullChunk(const RegionChunkHeader& header, const uint8_t* blob, uint32_t size, Chunk& chunk)
+{
+	const size_t paletteBytes = header.paletteSize * sizeof(uint32_t);
+	if (header.paletteSize == 0 || (header.indexSize != 1 && header.indexSize != 2) || sizeof(header) + paletteBytes + header.dataSize > size)
+		return false;
+
+	uint32_t palette[ChunkVoxelCount];
+	if (header.paletteSize > ChunkVoxelCount)
+		return false;
+	memcpy(palette, blob + sizeof(header), paletteBytes);
+
+	uint8_t indices[ChunkVoxelCount * 2];
+	const int indicesSize = static_cast<int>(ChunkVoxelCount * header.indexSize);
+	const char* compressed = reinterpret_cast<const char*>(blob + sizeof(header) + paletteBytes);
+	if (tracy::LZ4_decompress_safe(compressed, reinterpret_cast<char*>(indices), static_cast<int>(header.dataSize), indicesSize) != indicesSize)
+		return false;
+
+	chunk.blocks.resize(ChunkVoxelCount);
+	uint32_t* blocks = chunk.blocks.data();
+
+	if (header.indexSize == 1)
+	{
+		for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; ++voxelIt)
+		{
+			if (indices[voxelIt] >= header.paletteSize)
+				return false;
+			blocks[voxelIt] = palette[indices[voxelIt]];
+		}
+	}
+	else
+	{
+		for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; ++voxelIt)
+		{
+			uint16_t index;
+			memcpy(&index, &indices[voxelIt * 2], sizeof(index));
+			if (index >= header.paletteSize)
+				return false;
+			blocks[voxelIt] = palette[index];
+		}
+	}
+
+	return true;
+}
+
+static void encodeDiffChunk(const ChunkSnapshot& chunk, size_t editCount, std::vector<uint8_t>& outBlob)
+{
+	RegionChunkHeader header;
+	header.kind = RegionChunkDiff;
+	header.indexSize = 0;
+	header.paletteSize = 0;
+	header.dataSize = static_cast<uint32_t>(editCount);
+
+	outBlob.resize(sizeof(header) + editCount * (sizeof(uint16_t) + sizeof(uint32_t)));
+	memcpy(&outBlob[0], &header, sizeof(header));
+
+	uint8_t* indices = &outBlob[sizeof(header)];
+	uint8_t* blocks = indices + editCount * sizeof(uint16_t);
+
+	for (size_t wordIt = 0; wordIt < chunk.editMask.size(); ++wordIt)
+	{
+		for (uint64_t word = chunk.editMask[wordIt]; word != 0; word &= word - 1)
+		{
+			const uint16_t voxelIndex = static_cast<uint16_t>(wordIt * 64 + __builtin_ctzll(word));
+			const uint32_t block = chunk.blocks[voxelIndex];
+			memcpy(indices, &voxelIndex, sizeof(voxelIndex));
+			memcpy(blocks, &block, sizeof(block));
+			indices += sizeof(voxelIndex);
+			blocks += sizeof(block);
+		}
+	}
+}
+
+static bool decodeDiffChunk(const RegionChunkHeader& header, const uint8_t* blob, uint32_t size, std::vector<VoxelEdit>& outDiff)
+{
+	const size_t editCount = header.dataSize;
+	if (editCount > ChunkVoxelCount || sizeof(header) + editCount * (sizeof(uint16_t) + sizeof(uint32_t)) > size)
+		return false;
+
+	const uint8_t* indices = blob + sizeof(header);
+	const uint8_t* blocks = indices + editCount * sizeof(uint16_t);
+
+	outDiff.resize(editCount);
+	for (size_t editIt = 0; editIt < editCount; ++editIt)
+	{
+		uint16_t voxelIndex;
+		memcpy(&voxelIndex, indices + editIt * sizeof(uint16_t), sizeof(voxelIndex));
+		memcpy(&outDiff[editIt].block, blocks + editIt * sizeof(uint32_t), sizeof(uint32_t));
+		outDiff[editIt].voxelIndex = voxelIndex;
+
+		if (voxelIndex >= ChunkVoxelCount)
+			return false;
+	}
+
+	return true;
+}
+
+void encodeRegionChunk(const ChunkSnapshot& chunk, std::vector<uint8_t>& outBlob)
+{
+	size_t editCount = 0;
+	for (uint64_t word : chunk.editMask)
+	{
+		editCount += __builtin_popcountll(word);
+	}
+
+	if (editCount > 0 && editCount <= MaxDiffVoxelCount)
+	{
+		encodeDiffChunk(chunk, editCount, outBlob);
+	}
+	else
+	{
+		encodeFullChunk(chunk, outBlob);
+	}
+}
+
+RegionChunkKind decodeRegionChunk(const uint8_t* blob, uint32_t size, Chunk& chunk, std::vector<VoxelEdit>& outDiff)
+{
+	RegionChunkHeader header;
+	if (size < sizeof(header))
+		return RegionChunkNone;
+
+	memcpy(&header, blob, sizeof(header));
+
+	switch (header.kind)
+	{
+	case RegionChunkFull:
+		return decodeFullChunk(header, blob, size, chunk) ? RegionChunkFull : RegionChunkNone;
+	case RegionChunkDiff:
+		return decodeDiffChunk(header, blob, size, outDiff) ? RegionChunkDiff : RegionChunkNone;
+	default:
+		return RegionChunkNone;
+	}
+}
+
+bool CRegionReader::Open(const char* path, int32_t regionX, int32_t regionZ)
+{
+	ZoneScoped;
+
+	recoverRegionFile(path, regionX, regionZ);
+
+	const int file = open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < RegionDataOffset)
+	{
+		TRACE("Region file %s is truncated", path);
+		close(file);
+		return false;
+	}
+
+	_size = static_cast<size_t>(fileStat.st_size);
+
+#ifdef __SWITCH__
+	_buffer.resize(_size);
+	size_t readSize = 0;
+	while (readSize < _size)
+	{
+		const ssize_t result = read(file, &_buffer[readSize], _size - readSize);
+		if (result <= 0)
+			break;
+		readSize += static_cast<size_t>(result);
+	}
+	close(file);
+
+	if (readSize != _size)
+	{
+		TRACE("Could not read region file %s", path);
+		Close();
+		return false;
+	}
+	_data = _buffer.data();
+#else
+	void* mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (mapping == MAP_FAILED)
+	{
+		TRACE("Could not map region file %s", path);
+		_size = 0;
+		return false;
+	}
+	_data = static_cast<const uint8_t*>(mapping);
+#endif
+
+	RegionFileHeader header;
+	memcpy(&header, _data, sizeof(header));
+	if (header.magic != RegionFileMagic || header.version != RegionFileVersion || header.regionX != regionX || header.regionZ != regionZ)
+	{
+		TRACE("Region file %s doesn't match region %d, %d", path, regionX, regionZ);
+		Close();
+		return false;
+	}
+
+	_hasCurrentDiffs = header.worldGenVersion == WorldGenVersion;
+	if (!_hasCurrentDiffs)
+	{
+		TRACE("Region file %s is from world gen version %u, its diffs are dropped", path, header.worldGenVersion);
+	}
+
+	_slots = reinterpret_cast<const RegionChunkSlot*>(_data + RegionTableOffset);
+	return true;
+}
+
+void CRegionReader::Close()
+{
+#ifdef __SWITCH__
+	_buffer.clear();
+	_buffer.shrink_to_fit();
+#else
+	if (_data)
+	{
+		munmap(const_cast<uint8_t*>(_data), _size);
+	}
+#endif
+	_data = nullptr;
+	_size = 0;
+	_slots = nullptr;
+	_hasCurrentDiffs = false;
+}
+
+bool CRegionReader::HasChunk(size_t index) const
+{
+	uint32_t size;
+	return GetChunkBlob(index, size) != nullptr;
+}
+
+RegionChunkKind CRegionReader::ReadChunk(Chunk& chunk, std::vector<VoxelEdit>& outDiff) const
+{
+	ZoneScoped;
+
+	uint32_t size;
+	const uint8_t* blob = GetChunkBlob(getRegionChunkIndex(chunk.x, chunk.y, chunk.z), size);
+	return blob ? decodeRegionChunk(blob, size, chunk, outDiff) : RegionChunkNone;
+}
+
+const uint8_t* CRegionReader::GetChunkBlob(size_t index, uint32_t& outSize) const
+{
+	if (!_slots || _slots[index].size == 0)
+		return nullptr;
+
+	const RegionChunkSlot slot = _slots[index];
+	if (slot.offset < RegionDataOffset || static_cast<size_t>(slot.offset) + slot.size > _size)
+		return nullptr;
+
+	// A diff only makes sense against the blocks the generator produced when it was saved
+	if (!_hasCurrentDiffs && _data[slot.offset + offsetof(RegionChunkHeader, kind)] == RegionChunkDiff)
+		return nullptr;
+
+	outSize = slot.size;
+	return _data + slot.offset;
+}
+
+bool CRegionWriter::Begin(const char* path, int32_t regionX, int32_t regionZ)
+{
+	_path = path;
+	_tempPath = _path + ".tmp";
+	_slots.assign(RegionChunkCount, RegionChunkSlot{ 0, 0 });
+	_offset = static_cast<uint32_t>(RegionDataOffset);
+	_hasFailed = false;
+
+	_file = fopen(_tempPath.c_str(), "wb");
+	if (!_file)
+	{
+		TRACE("Could not create region file %s", _tempPath.c_str());
+		return false;
+	}
+
+	// The offset table and the magic are written last, leave room for them
+	_header = { 0, RegionFileVersion, regionX, regionZ, WorldGenVersion };
+	const RegionFileHeader& header = _header;
+	if (fwrite(&header, sizeof(header), 1, _file) != 1 || fwrite(_slots.data(), sizeof(RegionChunkSlot), _slots.size(), _file) != _slots.size())
+	{
+		Abort();
+		return false;
+	}
+
+	return true;
+}
+
+bool CRegionWriter::WriteChunk(const ChunkSnapshot& chunk)
+{
+	encodeRegionChunk(chunk, _encodeBuffer);
+	return Append(getRegionChunkIndex(chunk.x, chunk.y, chunk.z), _encodeBuffer.data(), static_cast<uint32_t>(_encodeBuffer.size()));
+}
+
+bool CRegionWriter::WriteChunkBlob(size_t index, const uint8_t* blob, uint32_t size)
+{
+	return Append(index, blob, size);
+}
+
+bool CRegionWriter::Append(size_t index, const void* data, uint32_t size)
+{
+	if (_hasFailed)
+		return false;
+
+	if (fwrite(data, 1, size, _file) != size)
+	{
+		TRACE("Could not write to region file %s", _tempPath.c_str());
+		_hasFailed = true;
+		return false;
+	}
+
+	_slots[index] = { _offset, size };
+	_offset += size;
+	return true;
+}
+
+bool CRegionWriter::End()
+{
+	// The blobs and the offset table have to be on disk before the magic is, a file with its magic but without its
+	// table would be taken as complete by recoverRegionFile()
+	_header.magic = RegionFileMagic;
+	if (_hasFailed || fseek(_file, static_cast<long>(RegionTableOffset), SEEK_SET) != 0
+		|| fwrite(_slots.data(), sizeof(RegionChunkSlot), _slots.size(), _file) != _slots.size()
+		|| fflush(_file) != 0 || fsync(fileno(_file)) != 0
+		|| fseek(_file, 0, SEEK_SET) != 0 || fwrite(&_header, sizeof(_header), 1, _file) != 1
+		|| fflush(_file) != 0 || fsync(fileno(_file)) != 0)
+	{
+		Abort();
+		return false;
+	}
+
+	const bool isClosed = fclose(_file) == 0;
+	_file = nullptr;
+
+	// The temp file is complete once its magic is written, it's kept when it can't be moved into place and the
+	// region is recovered from it on next open
+	if (!isClosed || !replaceFile(_tempPath, _path))
+	{
+		TRACE("Could not replace region file %s", _path.c_str());
+		return false;
+	}
+
+	// Until the directory is synced the rename may not survive a power loss, the temp file is still recovered then
+	if (!syncParentDirectory(_path))
+	{
+		TRACE("Could not sync the directory of region file %s", _path.c_str());
+	}
+
+	return true;
+}
+
+void CRegionWriter::Abort()
+{
+	if (_file)
+	{
+		fclose(_file);
+		_file = nullptr;
+	}
+	remove(_tempPath.c_str());
+}
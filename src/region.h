@@ -0,0 +1,135 @@
+#pragma once
+
+#include "world.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+struct Chunk;
+struct ChunkSnapshot;
+
+// A region file holds RegionSize x RegionSize chunk columns, WorldHeightChunks chunks each.
+// Layout: RegionFileHeader, then the offset table with one RegionChunkSlot per chunk (size 0 when
+// the chunk isn't stored), then the chunk blobs. A blob starts with a RegionChunkHeader.
+// Full chunks follow it with the palette of block IDs and the LZ4 compressed palette indices of all
+// voxels, one or two bytes each. Since generation is deterministic, most chunks are stored as a diff
+// against what the generator produces instead: the 16-bit voxel indices of the edited voxels
+// followed by their 32-bit blocks. Diffs only apply to the WorldGenVersion in the header, the
+// diffs of a file written by another version are dropped and their chunks are generated again.
+constexpr int32_t RegionSize = 32;
+constexpr size_t RegionChunkCount = RegionSize * RegionSize * WorldHeightChunks;
+
+// Chunks with more edited voxels are stored in full
+constexpr size_t MaxDiffVoxelCount = 512;
+
+enum RegionChunkKind : uint8_t
+{
+	// Not stored at all
+	RegionChunkNone,
+	RegionChunkFull,
+	RegionChunkDiff
+};
+
+struct VoxelEdit
+{
+	uint32_t voxelIndex;
+	uint32_t block;
+};
+
+struct RegionFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t regionX;
+	int32_t regionZ;
+	uint32_t worldGenVersion;
+};
+
+struct RegionChunkSlot
+{
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct RegionChunkHeader
+{
+	uint8_t kind;
+	uint8_t indexSize;
+	uint16_t paletteSize;
+	// Compressed size of full chunks, voxel count of diffs
+	uint32_t dataSize;
+};
+
+inline int32_t getRegionCoord(int32_t chunkCoord)
+{
+	return (chunkCoord >= 0 ? chunkCoord : chunkCoord - RegionSize + 1) / RegionSize;
+}
+
+// Slot of a chunk within its region, the chunks of a column are next to each other
+inline size_t getRegionChunkIndex(int32_t chunkX, int32_t chunkY, int32_t chunkZ)
+{
+	const size_t localX = static_cast<size_t>(chunkX - getRegionCoord(chunkX) * RegionSize);
+	const size_t localZ = static_cast<size_t>(chunkZ - getRegionCoord(chunkZ) * RegionSize);
+	return static_cast<size_t>(chunkY) + WorldHeightChunks * (localX + RegionSize * localZ);
+}
+
+// Read access to a region file. The file is memory mapped, so reading a chunk is a lookup in the
+// offset table plus decompression. Reading is thread safe once the file is open.
+class CRegionReader
+{
+public:
+	bool Open(const char* path, int32_t regionX, int32_t regionZ);
+	void Close();
+
+	// Diffs against another WorldGenVersion don't count as stored
+	bool HasChunk(size_t index) const;
+	// Decodes the chunk at the chunk's coordinates, see decodeRegionChunk()
+	RegionChunkKind ReadChunk(Chunk& chunk, std::vector<VoxelEdit>& outDiff) const;
+	// The stored blob of a chunk, to copy it to another region file without decoding it
+	const uint8_t* GetChunkBlob(size_t index, uint32_t& outSize) const;
+
+private:
+	const uint8_t* _data = nullptr;
+	size_t _size = 0;
+	const RegionChunkSlot* _slots = nullptr;
+	bool _hasCurrentDiffs = false;
+#ifdef __SWITCH__
+	// No mmap on the Switch, the file is read in one go instead
+	std::vector<uint8_t> _buffer;
+#endif
+};
+
+// Writes a region file front to back into a temp file. Chunks are appended as they come and the
+// offset table is filled in by End(). The temp file only replaces an existing one once it has been
+// written completely, CRegionReader::Open() finishes the replacement if End() was interrupted.
+class CRegionWriter
+{
+public:
+	bool Begin(const char* path, int32_t regionX, int32_t regionZ);
+	bool WriteChunk(const ChunkSnapshot& chunk);
+	bool WriteChunkBlob(size_t index, const uint8_t* blob, uint32_t size);
+	bool End();
+	// Drops the partially written file
+	void Abort();
+
+private:
+	bool Append(size_t index, const void* data, uint32_t size);
+
+	std::string _path;
+	std::string _tempPath;
+	RegionFileHeader _header;
+	FILE* _file = nullptr;
+	uint32_t _offset = 0;
+	std::vector<RegionChunkSlot> _slots;
+	std::vector<uint8_t> _encodeBuffer;
+	bool _hasFailed = false;
+};
+
+// Encodes a chunk as a diff of its edited voxels, or in full when it has too many of them or
+// doesn't track its edits
+void encodeRegionChunk(const ChunkSnapshot& chunk, std::vector<uint8_t>& outBlob);
+// Full chunks are decoded into the chunk's blocks, diffs into outDiff. RegionChunkNone when the blob is invalid
+RegionChunkKind decodeRegionChunk(const uint8_t* blob, uint32_t size, Chunk& chunk, std::vector<VoxelEdit>& outDiff);
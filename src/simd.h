@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// 4-wide SIMD types on top of the GCC vector extensions. They compile to NEON on the
+// Switch and to SSE on a desktop build, so the same code runs on both. Comparisons
+// yield int4 masks with all bits set for true lanes, usable with the ?: operator.
+typedef float float4 __attribute__((vector_size(16)));
+typedef int32_t int4 __attribute__((vector_size(16)));
+typedef uint32_t uint4 __attribute__((vector_size(16)));
+
+// 16-wide byte types for work on whole chunk rows, their comparisons yield int8x16 masks
+typedef int8_t int8x16 __attribute__((vector_size(16)));
+typedef uint8_t uint8x16 __attribute__((vector_size(16)));
+
+inline float4 splat4(float value)
+{
+	return float4{ value, value, value, value };
+}
+
+inline int4 splat4(int32_t value)
+{
+	return int4{ value, value, value, value };
+}
+
+inline uint4 splat4(uint32_t value)
+{
+	return uint4{ value, value, value, value };
+}
+
+inline int8x16 splat16(int8_t value)
+{
+	return int8x16{ value, value, value, value, value, value, value, value, value, value, value, value, value, value, value, value };
+}
+
+inline uint8x16 splat16(uint8_t value)
+{
+	return uint8x16{ value, value, value, value, value, value, value, value, value, value, value, value, value, value, value, value };
+}
+
+inline bool isAnyLaneSet(int8x16 mask)
+{
+	uint64_t halves[2];
+	memcpy(halves, &mask, sizeof(halves));
+	return (halves[0] | halves[1]) != 0;
+}
+
+// Unaligned loads and stores
+inline float4 load4(const float* src)
+{
+	float4 result;
+	memcpy(&result, src, sizeof(result));
+	return result;
+}
+
+inline uint4 load4(const uint32_t* src)
+{
+	uint4 result;
+	memcpy(&result, src, sizeof(result));
+	return result;
+}
+
+inline void store4(float* dst, float4 value)
+{
+	memcpy(dst, &value, sizeof(value));
+}
+
+inline void store4(uint32_t* dst, uint4 value)
+{
+	memcpy(dst, &value, sizeof(value));
+}
+
+inline float4 toFloat4(int4 value)
+{
+	return float4{ static_cast<float>(value[0]), static_cast<float>(value[1]), static_cast<float>(value[2]), static_cast<float>(value[3]) };
+}
+
+inline int4 floorToInt4(float4 value)
+{
+	// Truncation rounds towards zero, step the negative non-integers one down
+	const int4 truncated = int4{ static_cast<int32_t>(value[0]), static_cast<int32_t>(value[1]), static_cast<int32_t>(value[2]), static_cast<int32_t>(value[3]) };
+	return truncated + (value < toFloat4(truncated));
+}
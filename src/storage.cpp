@@ -0,0 +1,155 @@
+#include "storage.h"
+#include "chunk.h"
+#include "filesystem.h"
+#include "nxlink.h"
+
+#include "tracy/Tracy.hpp"
+
+#include <stdio.h>
+
+bool CWorldStorage::Init(const char* directory, uint32_t seed)
+{
+	char worldName[16];
+	snprintf(worldName, sizeof(worldName), "/%08x", seed);
+	_directory = std::string(directory) + worldName;
+
+	if (!createDirectories(_directory))
+	{
+		TRACE("Could not create world directory %s", _directory.c_str());
+		return false;
+	}
+
+	if (mtx_init(&_mutex, mtx_plain) != thrd_success || mtx_init(&_saveMutex, mtx_plain) != thrd_success)
+	{
+		TRACE("Could not create world storage mutex");
+		return false;
+	}
+
+	return true;
+}
+
+void CWorldStorage::Deinit()
+{
+	_regions.clear();
+
+	mtx_destroy(&_saveMutex);
+	mtx_destroy(&_mutex);
+}
+
+RegionChunkKind CWorldStorage::LoadChunk(Chunk& chunk, std::vector<VoxelEdit>& outDiff)
+{
+	ZoneScoped;
+
+	const ColumnCoord regionCoord = { getRegionCoord(chunk.x), getRegionCoord(chunk.z) };
+	RegionChunkKind kind = RegionChunkNone;
+
+	// The reference keeps the region open while decoding, even when a save replaces it meanwhile
+	mtx_lock(&_mutex);
+	const std::shared_ptr<const Region> region = GetRegion(regionCoord);
+	mtx_unlock(&_mutex);
+
+	if (region->isOpen && region->reader.HasChunk(getRegionChunkIndex(chunk.x, chunk.y, chunk.z)))
+	{
+		kind = region->reader.ReadChunk(chunk, outDiff);
+		if (kind == RegionChunkNone)
+		{
+			TRACE("Could not decode saved chunk %d, %d, %d", chunk.x, chunk.y, chunk.z);
+		}
+	}
+
+	return kind;
+}
+
+bool CWorldStorage::SaveChunks(const std::vector<ChunkSnapshot>& chunks)
+{
+	ZoneScoped;
+
+	std::unordered_map<ColumnCoord, std::vector<const ChunkSnapshot*>, ColumnCoordHash> regionChunks;
+	for (const ChunkSnapshot& chunk : chunks)
+	{
+		regionChunks[{ getRegionCoord(chunk.x), getRegionCoord(chunk.z) }].push_back(&chunk);
+	}
+
+	bool isSaved = true;
+	std::vector<bool> isWritten(RegionChunkCount);
+
+	mtx_lock(&_saveMutex);
+
+	for (const auto& entry : regionChunks)
+	{
+		const ColumnCoord& regionCoord = entry.first;
+		const std::string path = GetRegionPath(regionCoord);
+
+		// Opening the region recovers an interrupted save, before the writer starts over its temp file. The region
+		// stays in the map while it's written, so no load opens the file while it's being replaced
+		mtx_lock(&_mutex);
+		const std::shared_ptr<const Region> region = GetRegion(regionCoord);
+		mtx_unlock(&_mutex);
+
+		CRegionWriter writer;
+		if (!writer.Begin(path.c_str(), regionCoord.x, regionCoord.z))
+		{
+			isSaved = false;
+			continue;
+		}
+
+		isWritten.assign(RegionChunkCount, false);
+		bool isWriteOk = true;
+
+		for (const ChunkSnapshot* chunk : entry.second)
+		{
+			isWriteOk = isWriteOk && writer.WriteChunk(*chunk);
+			isWritten[getRegionChunkIndex(chunk->x, chunk->y, chunk->z)] = true;
+		}
+
+		// Carry over the chunks saved before as they are
+		for (size_t chunkIt = 0; chunkIt < RegionChunkCount && isWriteOk; ++chunkIt)
+		{
+			uint32_t blobSize;
+			const uint8_t* blob = !isWritten[chunkIt] && region->isOpen ? region->reader.GetChunkBlob(chunkIt, blobSize) : nullptr;
+			if (blob)
+			{
+				isWriteOk = writer.WriteChunkBlob(chunkIt, blob, blobSize);
+			}
+		}
+
+		if (!isWriteOk)
+		{
+			writer.Abort();
+			isSaved = false;
+		}
+		else if (!writer.End())
+		{
+			isSaved = false;
+		}
+
+		// The next load opens the new file, loads still holding the old region finish reading it first
+		mtx_lock(&_mutex);
+		_regions.erase(regionCoord);
+		mtx_unlock(&_mutex);
+	}
+
+	mtx_unlock(&_saveMutex);
+
+	return isSaved;
+}
+
+std::shared_ptr<const CWorldStorage::Region> CWorldStorage::GetRegion(const ColumnCoord& coord)
+{
+	auto it = _regions.find(coord);
+	if (it != _regions.end())
+		return it->second;
+
+	// A missing file is remembered as well, so loads from unsaved regions don't hit the file system
+	std::shared_ptr<Region> region = std::make_shared<Region>();
+	region->isOpen = region->reader.Open(GetRegionPath(coord).c_str(), coord.x, coord.z);
+	_regions[coord] = region;
+	return region;
+}
+
+std::string CWorldStorage::GetRegionPath(const ColumnCoord& coord) const
+{
+	char name[48];
+	snprintf(name, sizeof(name), "/r.%d.%d.region", coord.x, coord.z);
+	return _directory + name;
+}
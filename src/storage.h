@@ -0,0 +1,56 @@
+#pragma once
+
+#include "region.h"
+#include "world.h"
+
+#include <stdint.h>
+#include <threads.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Chunk;
+struct ChunkSnapshot;
+
+// Saved chunks of one world, kept in region files in a directory per world seed.
+// Region files are opened on first use and stay open until they are written. The mutex only guards
+// the lookup of the open regions, loads and saves hold a reference to the region they use instead, so
+// loads decode while a save writes and a region written by a save stays readable until its last load
+// is done with it.
+class CWorldStorage
+{
+public:
+	bool Init(const char* directory, uint32_t seed);
+	void Deinit();
+
+	// Looks up the chunk at its coordinates. Chunks saved in full are loaded into its blocks, for diffs
+	// outDiff receives the edits to apply once the chunk is generated. Thread safe
+	RegionChunkKind LoadChunk(Chunk& chunk, std::vector<VoxelEdit>& outDiff);
+
+	// Writes the chunks into their region files, keeping the other chunks already saved there.
+	// Thread safe, saves run one at a time and loads read the previous file until the new one is in place
+	bool SaveChunks(const std::vector<ChunkSnapshot>& chunks);
+
+	const std::string& GetDirectory() const { return _directory; }
+
+private:
+	struct Region
+	{
+		~Region() { reader.Close(); }
+
+		CRegionReader reader;
+		bool isOpen;
+	};
+
+	std::shared_ptr<const Region> GetRegion(const ColumnCoord& coord);
+	std::string GetRegionPath(const ColumnCoord& coord) const;
+
+	std::string _directory;
+
+	mtx_t _mutex;
+	std::unordered_map<ColumnCoord, std::shared_ptr<const Region>, ColumnCoordHash> _regions;
+	// Held for a whole save, a region is never written twice at once
+	mtx_t _saveMutex;
+};
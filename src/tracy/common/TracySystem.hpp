@@ -16,6 +16,7 @@ extern "C" __declspec(dllimport) unsigned long __stdcall GetCurrentThreadId(void
 #endif
 #else
 #  include <pthread.h>
+#  include <threads.h>
 #endif
 #endif
 
@@ -0,0 +1,280 @@
+#include "world.h"
+#include "block.h"
+#include "chunk.h"
+#include "editlog.h"
+#include "light.h"
+#include "occupancy.h"
+
+#include <algorithm>
+
+int32_t getChunkCoord(int32_t blockCoord, size_t chunkSize)
+{
+	const int32_t size = static_cast<int32_t>(chunkSize);
+	return (blockCoord >= 0 ? blockCoord : blockCoord - size + 1) / size;
+}
+
+size_t getLocalCoord(int32_t blockCoord, size_t chunkSize)
+{
+	return static_cast<size_t>(blockCoord - getChunkCoord(blockCoord, chunkSize) * static_cast<int32_t>(chunkSize));
+}
+
+void initWorld(World& world, uint32_t seed)
+{
+	world.seed = seed;
+	world.chunks.clear();
+	world.columns.clear();
+	world.editLog = nullptr;
+	world.dirtyChunks.clear();
+	world.dirtySkyColumns.clear();
+	// Below the world, so no chunk has it
+	world.coldChunkCursor = { 0, -1, 0 };
+}
+
+void deinitWorld(World& world)
+{
+	for (auto& entry : world.chunks)
+	{
+		delete entry.second;
+	}
+	world.chunks.clear();
+
+	for (auto& entry : world.columns)
+	{
+		delete entry.second;
+	}
+	world.columns.clear();
+	world.dirtyChunks.clear();
+	world.dirtySkyColumns.clear();
+}
+
+Chunk* findChunk(const World& world, const ChunkCoord& coord)
+{
+	auto it = world.chunks.find(coord);
+	return it != world.chunks.end() ? it->second : nullptr;
+}
+
+ChunkColumn* findColumn(const World& world, const ColumnCoord& coord)
+{
+	auto it = world.columns.find(coord);
+	return it != world.columns.end() ? it->second : nullptr;
+}
+
+uint32_t getBlock(const World& world, int32_t x, int32_t y, int32_t z)
+{
+	const Chunk* chunk = findChunk(world, { getChunkCoord(x, ChunkWidth), getChunkCoord(y, ChunkHeight), getChunkCoord(z, ChunkDepth) });
+	if (!chunk || !chunk->isComplete)
+		return BlockAir;
+
+	return chunk->blocks[getVoxelIndex(getLocalCoord(x, ChunkWidth), getLocalCoord(y, ChunkHeight), getLocalCoord(z, ChunkDepth))];
+}
+
+bool setBlock(World& world, int32_t x, int32_t y, int32_t z, uint32_t block)
+{
+	const ChunkCoord coord = { getChunkCoord(x, ChunkWidth), getChunkCoord(y, ChunkHeight), getChunkCoord(z, ChunkDepth) };
+	Chunk* chunk = findChunk(world, coord);
+	if (!chunk || !chunk->isComplete)
+		return false;
+
+	const uint32_t voxelIndex = static_cast<uint32_t>(getVoxelIndex(getLocalCoord(x, ChunkWidth), getLocalCoord(y, ChunkHeight), getLocalCoord(z, ChunkDepth)));
+	const uint32_t oldBlock = static_cast<const Chunk*>(chunk)->blocks[voxelIndex];
+	if (oldBlock == block)
+		return true;
+
+	chunk->blocks[voxelIndex] = block;
+	markVoxelEdited(*chunk, voxelIndex);
+	updateVoxelOccupancy(*chunk, voxelIndex, block);
+	const uint16_t lightVoxelIndex = static_cast<uint16_t>(voxelIndex);
+	updateBlockLight(world, *chunk, &lightVoxelIndex, 1);
+	updateColumnInfo(world, x, y, z, block);
+	if (canChangeSkyLight(world, *chunk, voxelIndex))
+	{
+		updateSkyLight(world, *chunk, &lightVoxelIndex, 1);
+	}
+	markBlockDirty(world, x, y, z);
+
+	if (world.editLog)
+	{
+		world.editLog->Append(coord, voxelIndex, oldBlock, block);
+	}
+
+	return true;
+}
+
+void markBlockDirty(World& world, int32_t x, int32_t y, int32_t z)
+{
+	markBoxDirty(world, { x, y, z, x, y, z });
+}
+
+void markBoxDirty(World& world, const BlockBox& box)
+{
+	// Every section holding one of the blocks around the box can depend on the blocks in it, on a section
+	// or chunk border these are in the sections across it as well
+	const int32_t minX = box.minX - 1;
+	const int32_t minY = box.minY - 1;
+	const int32_t minZ = box.minZ - 1;
+	const int32_t maxX = box.maxX + 1;
+	const int32_t maxY = box.maxY + 1;
+	const int32_t maxZ = box.maxZ + 1;
+
+	for (int32_t chunkZ = getChunkCoord(minZ, ChunkDepth); chunkZ <= getChunkCoord(maxZ, ChunkDepth); ++chunkZ)
+	{
+		const int32_t chunkMinZ = chunkZ * static_cast<int32_t>(ChunkDepth);
+		const int32_t firstSection = (std::max(minZ, chunkMinZ) - chunkMinZ) / static_cast<int32_t>(ChunkSectionDepth);
+		const int32_t lastSection = (std::min(maxZ, chunkMinZ + static_cast<int32_t>(ChunkDepth) - 1) - chunkMinZ) / static_cast<int32_t>(ChunkSectionDepth);
+		const uint32_t sectionMask = ((2u << lastSection) - 1) & ~((1u << firstSection) - 1);
+
+		for (int32_t chunkY = getChunkCoord(minY, ChunkHeight); chunkY <= getChunkCoord(maxY, ChunkHeight); ++chunkY)
+		{
+			for (int32_t chunkX = getChunkCoord(minX, ChunkWidth); chunkX <= getChunkCoord(maxX, ChunkWidth); ++chunkX)
+			{
+				const ChunkCoord coord = { chunkX, chunkY, chunkZ };
+				const Chunk* chunk = findChunk(world, coord);
+				if (chunk && chunk->isComplete)
+				{
+					world.dirtyChunks[coord] |= sectionMask;
+				}
+			}
+		}
+	}
+}
+
+size_t compressColdChunks(World& world, uint32_t coldSeconds, size_t maxCount, size_t maxScanCount)
+{
+	const uint32_t time = BlockStorage::getAccessTime();
+	if (time < coldSeconds || world.chunks.empty())
+		return 0;
+
+	// New chunks may reorder the map, that only shifts which chunks the cursor passes next
+	auto it = world.chunks.find(world.coldChunkCursor);
+	if (it == world.chunks.end())
+	{
+		it = world.chunks.begin();
+	}
+
+	size_t compressedCount = 0;
+	for (size_t scanCount = 0; scanCount < maxScanCount && scanCount < world.chunks.size() && compressedCount < maxCount; ++scanCount)
+	{
+		// Generation may still write into chunks that aren't complete
+		Chunk& chunk = *it->second;
+		if (chunk.isComplete && chunk.blocks.compressIfAccessedBefore(time - coldSeconds))
+		{
+			++compressedCount;
+		}
+
+		if (++it == world.chunks.end())
+		{
+			it = world.chunks.begin();
+		}
+	}
+
+	world.coldChunkCursor = it->first;
+	return compressedCount;
+}
+
+static ColumnInfo* getColumnInfo(const World& world, int32_t x, int32_t z)
+{
+	ChunkColumn* column = findColumn(world, { getChunkCoord(x, ChunkWidth), getChunkCoord(z, ChunkDepth) });
+	if (!column)
+		return nullptr;
+
+	return &column->columns[getLocalCoord(z, ChunkDepth)][getLocalCoord(x, ChunkWidth)];
+}
+
+const ColumnInfo* findColumnInfo(const World& world, int32_t x, int32_t z)
+{
+	return getColumnInfo(world, x, z);
+}
+
+void updateColumnInfo(ChunkColumn& column, const Chunk& chunk)
+{
+	const int32_t chunkY = chunk.y * static_cast<int32_t>(ChunkHeight);
+
+	for (size_t z = 0; z < ChunkDepth; ++z)
+	{
+		for (size_t x = 0; x < ChunkWidth; ++x)
+		{
+			ColumnInfo& info = column.columns[z][x];
+
+			// Chunks complete in any order, a lower one can't change the height once a higher one set it
+			if (info.height >= chunkY + static_cast<int32_t>(ChunkHeight))
+				continue;
+
+			for (size_t y = ChunkHeight; y-- > 0;)
+			{
+				const uint32_t block = chunk.blocks[getVoxelIndex(x, y, z)];
+				if (isSolidBlock(block))
+				{
+					const int32_t height = chunkY + static_cast<int32_t>(y);
+					if (height > info.height)
+					{
+						info.height = static_cast<int16_t>(height);
+						info.topBlock = static_cast<uint16_t>(block);
+					}
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Sets the info to the highest solid block of the block column at world x and z that is at or below y
+static void findColumnTop(const World& world, int32_t x, int32_t y, int32_t z, ColumnInfo& info)
+{
+	const int32_t chunkX = getChunkCoord(x, ChunkWidth);
+	const int32_t chunkZ = getChunkCoord(z, ChunkDepth);
+	const size_t localX = getLocalCoord(x, ChunkWidth);
+	const size_t localZ = getLocalCoord(z, ChunkDepth);
+
+	info.height = EmptyColumnHeight;
+	info.topBlock = BlockAir;
+
+	for (int32_t blockY = y; blockY >= 0; --blockY)
+	{
+		// Decoration jobs may still write into incomplete chunks, they fold themselves in once they complete
+		const Chunk* chunk = findChunk(world, { chunkX, getChunkCoord(blockY, ChunkHeight), chunkZ });
+		if (!chunk || !chunk->isComplete)
+		{
+			// Skip the whole missing or incomplete chunk
+			blockY -= static_cast<int32_t>(getLocalCoord(blockY, ChunkHeight));
+			continue;
+		}
+
+		const uint32_t below = chunk->blocks[getVoxelIndex(localX, getLocalCoord(blockY, ChunkHeight), localZ)];
+		if (isSolidBlock(below))
+		{
+			info.height = static_cast<int16_t>(blockY);
+			info.topBlock = static_cast<uint16_t>(below);
+			return;
+		}
+	}
+}
+
+void updateColumnInfo(World& world, int32_t x, int32_t y, int32_t z, uint32_t block)
+{
+	ColumnInfo* info = getColumnInfo(world, x, z);
+	if (!info || y < info->height)
+		return;
+
+	if (isSolidBlock(block))
+	{
+		info->height = static_cast<int16_t>(y);
+		info->topBlock = static_cast<uint16_t>(block);
+		return;
+	}
+
+	if (y != info->height)
+		return;
+
+	// The top block was removed, walk down to the next solid one
+	findColumnTop(world, x, y - 1, z, *info);
+}
+
+void refreshColumnInfo(World& world, int32_t x, int32_t z, int32_t maxY)
+{
+	// Nothing above maxY changed, a top block above it stays
+	ColumnInfo* info = getColumnInfo(world, x, z);
+	if (!info || info->height > maxY)
+		return;
+
+	findColumnTop(world, x, maxY, z, *info);
+}
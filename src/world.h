@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <unordered_set>
+
+class CEditLog;
+struct Chunk;
+struct ChunkColumn;
+struct ColumnInfo;
+
+// The world is WorldHeightChunks chunks tall, chunk y coordinates go from 0 to WorldHeightChunks - 1
+constexpr int32_t WorldHeightChunks = 4;
+
+struct ChunkCoord
+{
+	int32_t x;
+	int32_t y;
+	int32_t z;
+};
+
+inline bool operator==(const ChunkCoord& a, const ChunkCoord& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+inline bool operator!=(const ChunkCoord& a, const ChunkCoord& b)
+{
+	return !(a == b);
+}
+
+struct ChunkCoordHash
+{
+	size_t operator()(const ChunkCoord& coord) const
+	{
+		uint32_t hash = static_cast<uint32_t>(coord.x) * 0x8da6b343u;
+		hash ^= static_cast<uint32_t>(coord.y) * 0xd8163841u;
+		hash ^= static_cast<uint32_t>(coord.z) * 0xcb1ab31fu;
+		return hash ^ (hash >> 16);
+	}
+};
+
+// Box of world block coordinates, the maximum is inclusive
+struct BlockBox
+{
+	int32_t minX;
+	int32_t minY;
+	int32_t minZ;
+	int32_t maxX;
+	int32_t maxY;
+	int32_t maxZ;
+};
+
+// Chunk x and z of a column of chunks
+struct ColumnCoord
+{
+	int32_t x;
+	int32_t z;
+};
+
+inline bool operator==(const ColumnCoord& a, const ColumnCoord& b)
+{
+	return a.x == b.x && a.z == b.z;
+}
+
+struct ColumnCoordHash
+{
+	size_t operator()(const ColumnCoord& coord) const
+	{
+		uint32_t hash = static_cast<uint32_t>(coord.x) * 0x8da6b343u;
+		hash ^= static_cast<uint32_t>(coord.z) * 0xcb1ab31fu;
+		return hash ^ (hash >> 16);
+	}
+};
+
+struct World
+{
+	uint32_t seed;
+	std::unordered_map<ChunkCoord, Chunk*, ChunkCoordHash> chunks;
+	std::unordered_map<ColumnCoord, ChunkColumn*, ColumnCoordHash> columns;
+
+	// Optional, receives every edit made through setBlock()
+	CEditLog* editLog;
+
+	// Mask of the mesh sections of complete chunks that no longer match their blocks. Edits only collect them
+	// here, the renderer remeshes each of them once per frame however many edits it received
+	std::unordered_map<ChunkCoord, uint32_t, ChunkCoordHash> dirtyChunks;
+
+	// Chunk columns whose sky light may no longer match their blocks, see updateSkyLight()
+	std::unordered_set<ColumnCoord, ColumnCoordHash> dirtySkyColumns;
+
+	// Chunk the next compressColdChunks() starts looking at, from the first one when it doesn't exist
+	ChunkCoord coldChunkCursor;
+};
+
+void initWorld(World& world, uint32_t seed);
+void deinitWorld(World& world);
+
+Chunk* findChunk(const World& world, const ChunkCoord& coord);
+
+// Chunk coordinate of a world block coordinate and the block coordinate within that chunk
+int32_t getChunkCoord(int32_t blockCoord, size_t chunkSize);
+size_t getLocalCoord(int32_t blockCoord, size_t chunkSize);
+
+// Block at world coordinates, air where there is no complete chunk
+uint32_t getBlock(const World& world, int32_t x, int32_t y, int32_t z);
+
+// Compresses up to maxCount complete chunks that weren't accessed for coldSeconds, returns how many it did. Looks at
+// maxScanCount chunks at most, each call goes on where the last one stopped and wraps around to cover all chunks.
+// Main thread only, accessing a compressed chunk decompresses it again
+size_t compressColdChunks(World& world, uint32_t coldSeconds, size_t maxCount, size_t maxScanCount);
+
+// Changes a block at world coordinates, false if there is no complete chunk there.
+// Keeps the column info in sync, logs the edit and marks the affected chunks dirty. Main thread only
+bool setBlock(World& world, int32_t x, int32_t y, int32_t z, uint32_t block);
+
+// Marks the mesh sections that can see the block at world coordinates dirty, in its own and the neighbouring chunks
+void markBlockDirty(World& world, int32_t x, int32_t y, int32_t z);
+void markBoxDirty(World& world, const BlockBox& box);
+ChunkColumn* findColumn(const World& world, const ColumnCoord& coord);
+
+// Highest solid block of the block column at world x and z, null if the column isn't generated yet
+const ColumnInfo* findColumnInfo(const World& world, int32_t x, int32_t z);
+
+// Folds a completed chunk into the column info of its column
+void updateColumnInfo(ChunkColumn& column, const Chunk& chunk);
+
+// Keeps the column info in sync after the block at world x, y, z changed to block
+void updateColumnInfo(World& world, int32_t x, int32_t y, int32_t z, uint32_t block);
+
+// Keeps the column info in sync after any number of blocks up to maxY of the block column at world x and z changed
+void refreshColumnInfo(World& world, int32_t x, int32_t z, int32_t maxY);
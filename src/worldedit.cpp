@@ -0,0 +1,286 @@
+#include "worldedit.h"
+#include "block.h"
+#include "chunk.h"
+#include "editlog.h"
+#include "light.h"
+#include "occupancy.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "tracy/Tracy.hpp"
+
+// Applies an edit to every row of the box within the complete chunks it overlaps. getSpan narrows the x range of
+// the row at y and z to the blocks the edit covers, false skips the row. editBlocks returns the new blocks of up
+// to 4 consecutive blocks of a row from their current ones, the world coordinates of the first and the lane count
+template<typename GetSpan, typename EditBlocks>
+static size_t editBox(World& world, const BlockBox& box, GetSpan getSpan, EditBlocks editBlocks)
+{
+	size_t editCount = 0;
+
+	// Voxels changed in the current chunk, their light is updated in one pass per chunk
+	std::vector<uint16_t> changedVoxels;
+	changedVoxels.reserve(ChunkVoxelCount);
+
+	for (int32_t chunkZ = getChunkCoord(box.minZ, ChunkDepth); chunkZ <= getChunkCoord(box.maxZ, ChunkDepth); ++chunkZ)
+	{
+		for (int32_t chunkY = getChunkCoord(box.minY, ChunkHeight); chunkY <= getChunkCoord(box.maxY, ChunkHeight); ++chunkY)
+		{
+			for (int32_t chunkX = getChunkCoord(box.minX, ChunkWidth); chunkX <= getChunkCoord(box.maxX, ChunkWidth); ++chunkX)
+			{
+				const ChunkCoord coord = { chunkX, chunkY, chunkZ };
+				Chunk* chunk = findChunk(world, coord);
+				if (!chunk || !chunk->isComplete)
+					continue;
+
+				const int32_t chunkMinX = chunkX * static_cast<int32_t>(ChunkWidth);
+				const int32_t chunkMinY = chunkY * static_cast<int32_t>(ChunkHeight);
+				const int32_t chunkMinZ = chunkZ * static_cast<int32_t>(ChunkDepth);
+
+				const BlockBox chunkBox =
+				{
+					std::max(box.minX, chunkMinX),
+					std::max(box.minY, chunkMinY),
+					std::max(box.minZ, chunkMinZ),
+					std::min(box.maxX, chunkMinX + static_cast<int32_t>(ChunkWidth) - 1),
+					std::min(box.maxY, chunkMinY + static_cast<int32_t>(ChunkHeight) - 1),
+					std::min(box.maxZ, chunkMinZ + static_cast<int32_t>(ChunkDepth) - 1)
+				};
+
+				// Taking the pointer once makes the storage unique once for the whole chunk
+				uint32_t* blocks = chunk->blocks.data();
+				changedVoxels.clear();
+				bool canChangeSky = false;
+
+				for (int32_t z = chunkBox.minZ; z <= chunkBox.maxZ; ++z)
+				{
+					for (int32_t y = chunkBox.minY; y <= chunkBox.maxY; ++y)
+					{
+						int32_t spanMinX = chunkBox.minX;
+						int32_t spanMaxX = chunkBox.maxX;
+						if (!getSpan(y, z, spanMinX, spanMaxX))
+							continue;
+
+						spanMinX = std::max(spanMinX, chunkBox.minX);
+						spanMaxX = std::min(spanMaxX, chunkBox.maxX);
+
+						const size_t rowIndex = getVoxelIndex(0, y - chunkMinY, z - chunkMinZ);
+						for (int32_t x = spanMinX; x <= spanMaxX; x += 4)
+						{
+							const uint32_t voxelIndex = static_cast<uint32_t>(rowIndex + (x - chunkMinX));
+							const int32_t laneCount = std::min(4, spanMaxX - x + 1);
+							uint32_t* dst = blocks + voxelIndex;
+
+							// The lanes past the end of a short span are never read from or written to the chunk
+							uint32_t lanes[4] = {};
+							memcpy(lanes, dst, laneCount * sizeof(uint32_t));
+
+							const uint4 oldBlocks = load4(lanes);
+							const uint4 newBlocks = editBlocks(oldBlocks, x, y, z, laneCount);
+							const int4 isChanged = newBlocks != oldBlocks;
+							if ((isChanged[0] | isChanged[1] | isChanged[2] | isChanged[3]) == 0)
+								continue;
+
+							store4(lanes, newBlocks);
+							memcpy(dst, lanes, laneCount * sizeof(uint32_t));
+
+							for (int32_t lane = 0; lane < laneCount; ++lane)
+							{
+								if (!isChanged[lane])
+									continue;
+
+								markVoxelEdited(*chunk, voxelIndex + lane);
+								updateVoxelOccupancy(*chunk, voxelIndex + lane, newBlocks[lane]);
+								canChangeSky = canChangeSky || canChangeSkyLight(world, *chunk, voxelIndex + lane);
+								if (world.editLog)
+								{
+									world.editLog->Append(coord, voxelIndex + lane, oldBlocks[lane], newBlocks[lane]);
+								}
+								changedVoxels.push_back(static_cast<uint16_t>(voxelIndex + lane));
+							}
+						}
+					}
+				}
+
+				if (changedVoxels.empty())
+					continue;
+
+				markBoxDirty(world, chunkBox);
+				updateBlockLight(world, *chunk, changedVoxels.data(), changedVoxels.size());
+				for (int32_t z = chunkBox.minZ; z <= chunkBox.maxZ; ++z)
+				{
+					for (int32_t x = chunkBox.minX; x <= chunkBox.maxX; ++x)
+					{
+						refreshColumnInfo(world, x, z, chunkBox.maxY);
+					}
+				}
+				if (canChangeSky)
+				{
+					updateSkyLight(world, *chunk, changedVoxels.data(), changedVoxels.size());
+				}
+
+				editCount += changedVoxels.size();
+			}
+		}
+	}
+
+	return editCount;
+}
+
+static bool getFullSpan(int32_t, int32_t, int32_t&, int32_t&)
+{
+	return true;
+}
+
+size_t fillBox(World& world, const BlockBox& box, uint32_t block)
+{
+	ZoneScoped;
+
+	const uint4 newBlocks = splat4(block);
+	return editBox(world, box, getFullSpan, [newBlocks](uint4, int32_t, int32_t, int32_t, int32_t) { return newBlocks; });
+}
+
+size_t replaceBlocks(World& world, const BlockBox& box, uint32_t oldBlock, uint32_t newBlock)
+{
+	ZoneScoped;
+
+	const uint4 oldBlocks = splat4(oldBlock);
+	const uint4 newBlocks = splat4(newBlock);
+	return editBox(world, box, getFullSpan, [oldBlocks, newBlocks](uint4 blocks, int32_t, int32_t, int32_t, int32_t)
+	{
+		return blocks == oldBlocks ? newBlocks : blocks;
+	});
+}
+
+// Half width of the row of a disc at squared distance squaredDistance from its center, false if the row misses it
+static bool getDiscSpan(float radius, int32_t squaredDistance, int32_t& outHalfWidth)
+{
+	const float remaining = radius * radius - static_cast<float>(squaredDistance);
+	if (remaining < 0.0f)
+		return false;
+
+	outHalfWidth = static_cast<int32_t>(sqrtf(remaining));
+	return true;
+}
+
+size_t fillSphere(World& world, int32_t x, int32_t y, int32_t z, float radius, uint32_t block)
+{
+	ZoneScoped;
+
+	const int32_t extent = static_cast<int32_t>(radius);
+	const BlockBox box = { x - extent, y - extent, z - extent, x + extent, y + extent, z + extent };
+	const uint4 newBlocks = splat4(block);
+
+	return editBox(world, box,
+		[x, y, z, radius](int32_t rowY, int32_t rowZ, int32_t& minX, int32_t& maxX)
+		{
+			int32_t halfWidth;
+			if (!getDiscSpan(radius, (rowY - y) * (rowY - y) + (rowZ - z) * (rowZ - z), halfWidth))
+				return false;
+
+			minX = x - halfWidth;
+			maxX = x + halfWidth;
+			return true;
+		},
+		[newBlocks](uint4, int32_t, int32_t, int32_t, int32_t) { return newBlocks; });
+}
+
+size_t fillCylinder(World& world, int32_t x, int32_t y, int32_t z, float radius, int32_t height, uint32_t block)
+{
+	ZoneScoped;
+
+	if (height <= 0)
+		return 0;
+
+	const int32_t extent = static_cast<int32_t>(radius);
+	const BlockBox box = { x - extent, y, z - extent, x + extent, y + height - 1, z + extent };
+	const uint4 newBlocks = splat4(block);
+
+	return editBox(world, box,
+		[x, z, radius](int32_t, int32_t rowZ, int32_t& minX, int32_t& maxX)
+		{
+			int32_t halfWidth;
+			if (!getDiscSpan(radius, (rowZ - z) * (rowZ - z), halfWidth))
+				return false;
+
+			minX = x - halfWidth;
+			maxX = x + halfWidth;
+			return true;
+		},
+		[newBlocks](uint4, int32_t, int32_t, int32_t, int32_t) { return newBlocks; });
+}
+
+void copyBlocks(const World& world, const BlockBox& box, BlockClip& outClip)
+{
+	ZoneScoped;
+
+	outClip.sizeX = std::max(box.maxX - box.minX + 1, 0);
+	outClip.sizeY = std::max(box.maxY - box.minY + 1, 0);
+	outClip.sizeZ = std::max(box.maxZ - box.minZ + 1, 0);
+	outClip.blocks.assign(static_cast<size_t>(outClip.sizeX) * outClip.sizeY * outClip.sizeZ, BlockAir);
+
+	if (outClip.blocks.empty())
+		return;
+
+	// Copies the row of the clip that lies within each chunk in one go
+	for (int32_t chunkZ = getChunkCoord(box.minZ, ChunkDepth); chunkZ <= getChunkCoord(box.maxZ, ChunkDepth); ++chunkZ)
+	{
+		for (int32_t chunkY = getChunkCoord(box.minY, ChunkHeight); chunkY <= getChunkCoord(box.maxY, ChunkHeight); ++chunkY)
+		{
+			for (int32_t chunkX = getChunkCoord(box.minX, ChunkWidth); chunkX <= getChunkCoord(box.maxX, ChunkWidth); ++chunkX)
+			{
+				const Chunk* chunk = findChunk(world, { chunkX, chunkY, chunkZ });
+				if (!chunk || !chunk->isComplete)
+					continue;
+
+				const int32_t chunkMinX = chunkX * static_cast<int32_t>(ChunkWidth);
+				const int32_t chunkMinY = chunkY * static_cast<int32_t>(ChunkHeight);
+				const int32_t chunkMinZ = chunkZ * static_cast<int32_t>(ChunkDepth);
+
+				const int32_t minX = std::max(box.minX, chunkMinX);
+				const int32_t maxX = std::min(box.maxX, chunkMinX + static_cast<int32_t>(ChunkWidth) - 1);
+				const int32_t minY = std::max(box.minY, chunkMinY);
+				const int32_t maxY = std::min(box.maxY, chunkMinY + static_cast<int32_t>(ChunkHeight) - 1);
+				const int32_t minZ = std::max(box.minZ, chunkMinZ);
+				const int32_t maxZ = std::min(box.maxZ, chunkMinZ + static_cast<int32_t>(ChunkDepth) - 1);
+
+				const uint32_t* blocks = chunk->blocks.data();
+				for (int32_t z = minZ; z <= maxZ; ++z)
+				{
+					for (int32_t y = minY; y <= maxY; ++y)
+					{
+						const uint32_t* src = blocks + getVoxelIndex(minX - chunkMinX, y - chunkMinY, z - chunkMinZ);
+						uint32_t* dst = outClip.blocks.data() + ((static_cast<size_t>(z - box.minZ) * outClip.sizeY + (y - box.minY)) * outClip.sizeX + (minX - box.minX));
+						memcpy(dst, src, (maxX - minX + 1) * sizeof(uint32_t));
+					}
+				}
+			}
+		}
+	}
+}
+
+size_t pasteBlocks(World& world, const BlockClip& clip, int32_t x, int32_t y, int32_t z, bool pasteAir)
+{
+	ZoneScoped;
+
+	if (clip.blocks.empty())
+		return 0;
+
+	const BlockBox box = { x, y, z, x + clip.sizeX - 1, y + clip.sizeY - 1, z + clip.sizeZ - 1 };
+	const uint4 air = splat4(static_cast<uint32_t>(BlockAir));
+
+	return editBox(world, box, getFullSpan, [&clip, x, y, z, pasteAir, air](uint4 blocks, int32_t blockX, int32_t blockY, int32_t blockZ, int32_t laneCount)
+	{
+		const uint32_t* src = clip.blocks.data() + ((static_cast<size_t>(blockZ - z) * clip.sizeY + (blockY - y)) * clip.sizeX + (blockX - x));
+
+		uint32_t lanes[4] = {};
+		memcpy(lanes, src, laneCount * sizeof(uint32_t));
+		const uint4 clipBlocks = load4(lanes);
+
+		return pasteAir ? clipBlocks : (clipBlocks != air ? clipBlocks : blocks);
+	});
+}
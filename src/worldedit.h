@@ -0,0 +1,37 @@
+#pragma once
+
+#include "world.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Blocks of a box copied out of the world, x first, then y, then z like Chunk::blocks
+struct BlockClip
+{
+	int32_t sizeX;
+	int32_t sizeY;
+	int32_t sizeZ;
+	std::vector<uint32_t> blocks;
+};
+
+// Bulk edits of the complete chunks in a region of the world. They write whole spans of each chunk row
+// at once and do the bookkeeping of setBlock() only for the blocks that actually changed: the edit mask,
+// the edit log and the column info. Light is updated in one pass per chunk and every touched mesh section is
+// remeshed once, not once per block.
+// All return the number of blocks they changed. Main thread only
+size_t fillBox(World& world, const BlockBox& box, uint32_t block);
+size_t replaceBlocks(World& world, const BlockBox& box, uint32_t oldBlock, uint32_t newBlock);
+
+// Blocks whose center is within radius of the center of the block at x, y, z
+size_t fillSphere(World& world, int32_t x, int32_t y, int32_t z, float radius, uint32_t block);
+
+// Upright cylinder, height blocks tall from the block at x, y, z upwards
+size_t fillCylinder(World& world, int32_t x, int32_t y, int32_t z, float radius, int32_t height, uint32_t block);
+
+// Copies the box into outClip, air where there is no complete chunk
+void copyBlocks(const World& world, const BlockBox& box, BlockClip& outClip);
+
+// Pastes the clip with its first block at x, y, z. Air in the clip only overwrites blocks when pasteAir is set
+size_t pasteBlocks(World& world, const BlockClip& clip, int32_t x, int32_t y, int32_t z, bool pasteAir);
@@ -0,0 +1,315 @@
+#include "chunkcache.h"
+#include "worldgen.h"
+#include "../chunk.h"
+#include "../filesystem.h"
+#include "../nxlink.h"
+
+#include "../tracy/Tracy.hpp"
+#include "../tracy/common/tracy_lz4.hpp"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unordered_set>
+#include <vector>
+
+constexpr uint32_t ChunkFileMagic = 0x4b4e4843; // "CHNK"
+constexpr uint32_t IndexFileMagic = 0x58444e49; // "INDX"
+constexpr const char* IndexFileName = "index.bin";
+constexpr const char* ChunkFileExtension = ".chunk";
+
+constexpr int ChunkDataSize = static_cast<int>(ChunkVoxelCount * sizeof(uint32_t));
+
+struct ChunkFileHeader
+{
+	uint32_t magic;
+	uint32_t seed;
+	uint32_t version;
+	int32_t x;
+	int32_t y;
+	int32_t z;
+	uint32_t compressedSize;
+};
+
+struct IndexFileHeader
+{
+	uint32_t magic;
+	uint32_t entryCount;
+};
+
+size_t CChunkCache::KeyHash::operator()(const Key& key) const
+{
+	uint32_t hash = key.seed ^ (key.version * 0x9e3779b9u);
+	hash ^= static_cast<uint32_t>(key.x) * 0x8da6b343u;
+	hash ^= static_cast<uint32_t>(key.y) * 0xd8163841u;
+	hash ^= static_cast<uint32_t>(key.z) * 0xcb1ab31fu;
+	return hash ^ (hash >> 16);
+}
+
+bool CChunkCache::KeyEqual::operator()(const Key& a, const Key& b) const
+{
+	return a.seed == b.seed && a.version == b.version && a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+bool CChunkCache::Init(const char* directory, uint64_t maxBytes)
+{
+	_directory = directory;
+	_maxBytes = maxBytes;
+	_totalBytes = 0;
+
+	if (!createDirectories(_directory))
+	{
+		TRACE("Could not create chunk cache directory %s", directory);
+		return false;
+	}
+
+	if (mtx_init(&_mutex, mtx_plain) != thrd_success)
+	{
+		TRACE("Could not create chunk cache mutex");
+		return false;
+	}
+
+	LoadIndex();
+
+	// The budget may have shrunk since the index was saved
+	std::vector<Key> evictedKeys;
+	EvictOverBudget(evictedKeys);
+	for (const Key& evictedKey : evictedKeys)
+	{
+		remove(GetPath(evictedKey).c_str());
+	}
+
+	// Chunks stored after the index was last saved, e.g. when the app didn't shut down cleanly
+	RemoveUnindexedFiles();
+
+	return true;
+}
+
+void CChunkCache::Deinit()
+{
+	SaveIndex();
+
+	_entries.clear();
+	_entryList.clear();
+
+	mtx_destroy(&_mutex);
+}
+
+bool CChunkCache::Load(uint32_t seed, Chunk& chunk)
+{
+	ZoneScoped;
+
+	const Key key = { seed, WorldGenVersion, chunk.x, chunk.y, chunk.z };
+
+	mtx_lock(&_mutex);
+	auto it = _entries.find(key);
+	const bool isCached = it != _entries.end();
+	if (isCached)
+	{
+		_entryList.splice(_entryList.begin(), _entryList, it->second);
+	}
+	mtx_unlock(&_mutex);
+
+	if (!isCached)
+		return false;
+
+	const std::string path = GetPath(key);
+	FILE* file = fopen(path.c_str(), "rb");
+	bool isValid = false;
+
+	if (file)
+	{
+		ChunkFileHeader header;
+		if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == ChunkFileMagic && header.seed == key.seed && header.version == key.version
+			&& header.x == key.x && header.y == key.y && header.z == key.z && header.compressedSize <= static_cast<uint32_t>(tracy::LZ4_compressBound(ChunkDataSize)))
+		{
+			std::vector<char> compressed(header.compressedSize);
+			chunk.blocks.resize(ChunkVoxelCount);
+
+			isValid = fread(compressed.data(), 1, compressed.size(), file) == compressed.size()
+				&& tracy::LZ4_decompress_safe(compressed.data(), reinterpret_cast<char*>(chunk.blocks.data()), static_cast<int>(compressed.size()), ChunkDataSize) == ChunkDataSize;
+		}
+		fclose(file);
+	}
+
+	if (!isValid)
+	{
+		TRACE("Dropping unreadable cached chunk %s", path.c_str());
+
+		mtx_lock(&_mutex);
+		it = _entries.find(key);
+		if (it != _entries.end())
+		{
+			_totalBytes -= it->second->size;
+			_entryList.erase(it->second);
+			_entries.erase(it);
+		}
+		mtx_unlock(&_mutex);
+
+		remove(path.c_str());
+	}
+
+	return isValid;
+}
+
+void CChunkCache::Store(uint32_t seed, const Chunk& chunk)
+{
+	ZoneScoped;
+
+	const Key key = { seed, WorldGenVersion, chunk.x, chunk.y, chunk.z };
+
+	std::vector<char> compressed(tracy::LZ4_compressBound(ChunkDataSize));
+	const int compressedSize = tracy::LZ4_compress_default(reinterpret_cast<const char*>(chunk.blocks.data()), compressed.data(), ChunkDataSize, static_cast<int>(compressed.size()));
+	if (compressedSize <= 0)
+		return;
+
+	const ChunkFileHeader header = { ChunkFileMagic, key.seed, key.version, key.x, key.y, key.z, static_cast<uint32_t>(compressedSize) };
+
+	const std::string path = GetPath(key);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		TRACE("Could not write cached chunk %s", path.c_str());
+		return;
+	}
+
+	const bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(compressed.data(), 1, compressedSize, file) == static_cast<size_t>(compressedSize);
+	fclose(file);
+
+	if (!isWritten)
+	{
+		remove(path.c_str());
+		return;
+	}
+
+	const uint32_t size = static_cast<uint32_t>(sizeof(header) + compressedSize);
+	std::vector<Key> evictedKeys;
+
+	mtx_lock(&_mutex);
+
+	auto it = _entries.find(key);
+	if (it != _entries.end())
+	{
+		_totalBytes -= it->second->size;
+		it->second->size = size;
+		_entryList.splice(_entryList.begin(), _entryList, it->second);
+	}
+	else
+	{
+		_entryList.push_front({ key, size });
+		_entries[key] = _entryList.begin();
+	}
+	_totalBytes += size;
+
+	EvictOverBudget(evictedKeys);
+
+	mtx_unlock(&_mutex);
+
+	for (const Key& evictedKey : evictedKeys)
+	{
+		remove(GetPath(evictedKey).c_str());
+	}
+}
+
+void CChunkCache::EvictOverBudget(std::vector<Key>& outEvictedKeys)
+{
+	while (_totalBytes > _maxBytes && _entryList.size() > 1)
+	{
+		const Entry& oldest = _entryList.back();
+		outEvictedKeys.push_back(oldest.key);
+		_totalBytes -= oldest.size;
+		_entries.erase(oldest.key);
+		_entryList.pop_back();
+	}
+}
+
+std::string CChunkCache::GetPath(const Key& key) const
+{
+	char name[96];
+	snprintf(name, sizeof(name), "/%08x_%u_%d_%d_%d%s", key.seed, key.version, key.x, key.y, key.z, ChunkFileExtension);
+	return _directory + name;
+}
+
+void CChunkCache::LoadIndex()
+{
+	const std::string path = _directory + "/" + IndexFileName;
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return;
+
+	IndexFileHeader header;
+	if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == IndexFileMagic)
+	{
+		// Stored least recently used first
+		Entry entry;
+		for (uint32_t entryIt = 0; entryIt < header.entryCount && fread(&entry, sizeof(entry), 1, file) == 1; ++entryIt)
+		{
+			if (_entries.find(entry.key) != _entries.end())
+				continue;
+
+			_entryList.push_front(entry);
+			_entries[entry.key] = _entryList.begin();
+			_totalBytes += entry.size;
+		}
+	}
+
+	fclose(file);
+}
+
+void CChunkCache::SaveIndex()
+{
+	const std::string path = _directory + "/" + IndexFileName;
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		TRACE("Could not write chunk cache index %s", path.c_str());
+		return;
+	}
+
+	const IndexFileHeader header = { IndexFileMagic, static_cast<uint32_t>(_entryList.size()) };
+	fwrite(&header, sizeof(header), 1, file);
+
+	for (auto it = _entryList.rbegin(); it != _entryList.rend(); ++it)
+	{
+		fwrite(&*it, sizeof(*it), 1, file);
+	}
+
+	fclose(file);
+}
+
+void CChunkCache::RemoveUnindexedFiles()
+{
+	DIR* dir = opendir(_directory.c_str());
+	if (!dir)
+		return;
+
+	std::unordered_set<std::string> indexedPaths;
+	for (const Entry& entry : _entryList)
+	{
+		indexedPaths.insert(GetPath(entry.key));
+	}
+
+	const size_t extensionLength = strlen(ChunkFileExtension);
+	std::vector<std::string> unindexedPaths;
+
+	while (const dirent* dirEntry = readdir(dir))
+	{
+		const size_t nameLength = strlen(dirEntry->d_name);
+		if (nameLength <= extensionLength || strcmp(dirEntry->d_name + nameLength - extensionLength, ChunkFileExtension) != 0)
+			continue;
+
+		std::string path = _directory + "/" + dirEntry->d_name;
+		if (indexedPaths.find(path) == indexedPaths.end())
+		{
+			unindexedPaths.push_back(std::move(path));
+		}
+	}
+
+	closedir(dir);
+
+	for (const std::string& path : unindexedPaths)
+	{
+		remove(path.c_str());
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <threads.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Chunk;
+
+// On disk cache of the chunk local generation stages (up to and including caves), keyed by world seed,
+// chunk coordinates and WorldGenVersion. Every chunk is one LZ4 compressed file. The total size is
+// bounded, the least recently used chunks are evicted first. Load and Store are thread safe.
+class CChunkCache
+{
+public:
+	bool Init(const char* directory, uint64_t maxBytes);
+	// Saves the usage order so the next run evicts the right chunks
+	void Deinit();
+
+	// Fills the blocks of the chunk at its coordinates, false if it isn't cached
+	bool Load(uint32_t seed, Chunk& chunk);
+	void Store(uint32_t seed, const Chunk& chunk);
+
+private:
+	struct Key
+	{
+		uint32_t seed;
+		uint32_t version;
+		int32_t x;
+		int32_t y;
+		int32_t z;
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const;
+	};
+
+	struct KeyEqual
+	{
+		bool operator()(const Key& a, const Key& b) const;
+	};
+
+	struct Entry
+	{
+		Key key;
+		uint32_t size;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	std::string GetPath(const Key& key) const;
+	// Drops the least recently used entries until the cache fits, the caller holds the mutex and removes the files
+	void EvictOverBudget(std::vector<Key>& outEvictedKeys);
+	void LoadIndex();
+	void SaveIndex();
+	void RemoveUnindexedFiles();
+
+	std::string _directory;
+	uint64_t _maxBytes = 0;
+	uint64_t _totalBytes = 0;
+
+	mtx_t _mutex;
+	// Most recently used first
+	EntryList _entryList;
+	std::unordered_map<Key, EntryList::iterator, KeyHash, KeyEqual> _entries;
+};
@@ -0,0 +1,153 @@
+#include "noise.h"
+#include "../simd.h"
+
+#include <vector>
+
+static inline uint4 hashLattice(uint4 seed, int4 x, int4 y, int4 z)
+{
+	// Spread the coordinates with large odd constants, then a full avalanche so
+	// neighbouring lattice points get unrelated gradients
+	uint4 hash = seed ^ (reinterpret_cast<uint4&>(x) * 0x8da6b343u) ^ (reinterpret_cast<uint4&>(y) * 0xd8163841u) ^ (reinterpret_cast<uint4&>(z) * 0xcb1ab31fu);
+	hash ^= hash >> 16;
+	hash *= 0x7feb352du;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bu;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static inline float4 fade(float4 t)
+{
+	return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static inline float4 lerp(float4 a, float4 b, float4 t)
+{
+	return a + (b - a) * t;
+}
+
+// Dot product with one of the 8 gradients (+-1, +-1) and (+-1, 0), (0, +-1)
+static inline float4 gradient2D(uint4 hash, float4 x, float4 z)
+{
+	const int4 h = reinterpret_cast<int4&>(hash);
+	const float4 u = (h & 4) != 0 ? z : x;
+	const float4 v = (h & 4) != 0 ? x : z;
+	const float4 signedU = (h & 1) != 0 ? -u : u;
+	const float4 signedV = (h & 2) != 0 ? -v : v;
+	return signedU + ((h & 8) != 0 ? signedV : splat4(0.0f));
+}
+
+// Dot product with one of the 12 cube edge gradients, as in improved Perlin noise
+static inline float4 gradient3D(uint4 hash, float4 x, float4 y, float4 z)
+{
+	const int4 h = reinterpret_cast<int4&>(hash) & 15;
+	const float4 u = h < 8 ? x : y;
+	const float4 v = h < 4 ? y : (((h == 12) | (h == 14)) != 0 ? x : z);
+	return ((h & 1) != 0 ? -u : u) + ((h & 2) != 0 ? -v : v);
+}
+
+static inline float4 gradientNoise2D(uint4 seed, float4 x, float4 z)
+{
+	const int4 x0 = floorToInt4(x);
+	const int4 z0 = floorToInt4(z);
+	const int4 x1 = x0 + 1;
+	const int4 z1 = z0 + 1;
+	const int4 y0 = splat4(0);
+
+	const float4 fx = x - toFloat4(x0);
+	const float4 fz = z - toFloat4(z0);
+
+	const float4 n00 = gradient2D(hashLattice(seed, x0, y0, z0), fx, fz);
+	const float4 n10 = gradient2D(hashLattice(seed, x1, y0, z0), fx - 1.0f, fz);
+	const float4 n01 = gradient2D(hashLattice(seed, x0, y0, z1), fx, fz - 1.0f);
+	const float4 n11 = gradient2D(hashLattice(seed, x1, y0, z1), fx - 1.0f, fz - 1.0f);
+
+	const float4 u = fade(fx);
+	const float4 w = fade(fz);
+	return lerp(lerp(n00, n10, u), lerp(n01, n11, u), w);
+}
+
+static inline float4 gradientNoise3D(uint4 seed, float4 x, float4 y, float4 z)
+{
+	const int4 x0 = floorToInt4(x);
+	const int4 y0 = floorToInt4(y);
+	const int4 z0 = floorToInt4(z);
+	const int4 x1 = x0 + 1;
+	const int4 y1 = y0 + 1;
+	const int4 z1 = z0 + 1;
+
+	const float4 fx = x - toFloat4(x0);
+	const float4 fy = y - toFloat4(y0);
+	const float4 fz = z - toFloat4(z0);
+
+	const float4 n000 = gradient3D(hashLattice(seed, x0, y0, z0), fx, fy, fz);
+	const float4 n100 = gradient3D(hashLattice(seed, x1, y0, z0), fx - 1.0f, fy, fz);
+	const float4 n010 = gradient3D(hashLattice(seed, x0, y1, z0), fx, fy - 1.0f, fz);
+	const float4 n110 = gradient3D(hashLattice(seed, x1, y1, z0), fx - 1.0f, fy - 1.0f, fz);
+	const float4 n001 = gradient3D(hashLattice(seed, x0, y0, z1), fx, fy, fz - 1.0f);
+	const float4 n101 = gradient3D(hashLattice(seed, x1, y0, z1), fx - 1.0f, fy, fz - 1.0f);
+	const float4 n011 = gradient3D(hashLattice(seed, x0, y1, z1), fx, fy - 1.0f, fz - 1.0f);
+	const float4 n111 = gradient3D(hashLattice(seed, x1, y1, z1), fx - 1.0f, fy - 1.0f, fz - 1.0f);
+
+	const float4 u = fade(fx);
+	const float4 v = fade(fy);
+	const float4 w = fade(fz);
+	const float4 nx00 = lerp(n000, n100, u);
+	const float4 nx10 = lerp(n010, n110, u);
+	const float4 nx01 = lerp(n001, n101, u);
+	const float4 nx11 = lerp(n011, n111, u);
+	return lerp(lerp(nx00, nx10, v), lerp(nx01, nx11, v), w);
+}
+
+void gradientNoise2D(uint32_t seed, const float* x, const float* z, float* out, size_t count)
+{
+	const uint4 seed4 = splat4(seed);
+	for (size_t sampleIt = 0; sampleIt < count; sampleIt += 4)
+	{
+		store4(out + sampleIt, gradientNoise2D(seed4, load4(x + sampleIt), load4(z + sampleIt)));
+	}
+}
+
+void gradientNoise3D(uint32_t seed, const float* x, const float* y, const float* z, float* out, size_t count)
+{
+	const uint4 seed4 = splat4(seed);
+	for (size_t sampleIt = 0; sampleIt < count; sampleIt += 4)
+	{
+		store4(out + sampleIt, gradientNoise3D(seed4, load4(x + sampleIt), load4(y + sampleIt), load4(z + sampleIt)));
+	}
+}
+
+void fractalNoise2D(uint32_t seed, const float* x, const float* z, float* out, size_t count, uint32_t octaves, float lacunarity, float gain)
+{
+	for (size_t sampleIt = 0; sampleIt < count; sampleIt += 4)
+	{
+		const float4 baseX = load4(x + sampleIt);
+		const float4 baseZ = load4(z + sampleIt);
+
+		float4 sum = splat4(0.0f);
+		float frequency = 1.0f;
+		float amplitude = 1.0f;
+		float amplitudeSum = 0.0f;
+
+		for (uint32_t octave = 0; octave < octaves; ++octave)
+		{
+			// Every octave gets its own seed so the octaves don't line up at the origin
+			sum += gradientNoise2D(splat4(seed + octave * 0x9e3779b9u), baseX * frequency, baseZ * frequency) * amplitude;
+			amplitudeSum += amplitude;
+			frequency *= lacunarity;
+			amplitude *= gain;
+		}
+
+		store4(out + sampleIt, sum / amplitudeSum);
+	}
+}
+
+float gradientNoise2D(uint32_t seed, float x, float z)
+{
+	return gradientNoise2D(splat4(seed), splat4(x), splat4(z))[0];
+}
+
+float gradientNoise3D(uint32_t seed, float x, float y, float z)
+{
+	return gradientNoise3D(splat4(seed), splat4(x), splat4(y), splat4(z))[0];
+}
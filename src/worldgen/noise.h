@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Seedable gradient noise, deterministic for a given seed and coordinate no matter in
+// which order or on which thread it is evaluated. The batch functions evaluate four
+// samples at a time, count has to be a multiple of 4. Results are roughly in [-1, 1].
+
+void gradientNoise2D(uint32_t seed, const float* x, const float* z, float* out, size_t count);
+void gradientNoise3D(uint32_t seed, const float* x, const float* y, const float* z, float* out, size_t count);
+
+// Sum of octaves of 2D gradient noise, normalised back to roughly [-1, 1]
+void fractalNoise2D(uint32_t seed, const float* x, const float* z, float* out, size_t count, uint32_t octaves, float lacunarity, float gain);
+
+float gradientNoise2D(uint32_t seed, float x, float z);
+float gradientNoise3D(uint32_t seed, float x, float y, float z);
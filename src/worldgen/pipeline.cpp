@@ -0,0 +1,410 @@
+#include "pipeline.h"
+#include "worldgen.h"
+#include "../chunk.h"
+#include "../nxlink.h"
+#include "../occupancy.h"
+
+#include "../tracy/Tracy.hpp"
+
+// How far around the chunk a stage reads or writes, it needs those neighbours at the previous stage
+static int32_t getStageRadius(uint8_t stage)
+{
+	return stage == GenStageDecorated ? 1 : 0;
+}
+
+static bool isInsideWorld(const ChunkCoord& coord)
+{
+	return coord.y >= 0 && coord.y < WorldHeightChunks;
+}
+
+// Blocks of a chunk through the chunk local stages, before any decorations
+static Chunk* generateUndecorated(const ChunkCoord& coord, const ChunkColumn& column, uint32_t seed, CChunkCache* cache)
+{
+	Chunk* chunk = new Chunk();
+	chunk->x = coord.x;
+	chunk->y = coord.y;
+	chunk->z = coord.z;
+	chunk->blocks.resize(ChunkVoxelCount);
+
+	if (!cache || !cache->Load(seed, *chunk))
+	{
+		generateDensity(*chunk, column, seed);
+		generateSurface(*chunk, column, seed);
+		generateCaves(*chunk, seed);
+	}
+	return chunk;
+}
+
+// Decorates a chunk next to chunks saved in full, which already hold their decorations and are null in the
+// neighbourhood so that they keep their blocks. When the chunk itself is saved, a regenerated copy of it is
+// decorated instead, so its decorations still reach the neighbours that aren't saved. Trees on the top layer
+// look at the block above them, a saved chunk above is regenerated as well to be read but not written
+static void decorateNearSavedChunks(Chunk* const neighbourhood[27], const ChunkColumn& column, uint32_t seed, CChunkCache* cache,
+	bool isSaved, bool isAboveSaved)
+{
+	const Chunk& chunk = *neighbourhood[getNeighbourhoodIndex(0, 0, 0)];
+
+	Chunk* scratchNeighbourhood[27];
+	for (int32_t index = 0; index < 27; ++index)
+	{
+		scratchNeighbourhood[index] = neighbourhood[index];
+	}
+
+	Chunk* undecorated = nullptr;
+	if (isSaved)
+	{
+		undecorated = generateUndecorated({ chunk.x, chunk.y, chunk.z }, column, seed, cache);
+		scratchNeighbourhood[getNeighbourhoodIndex(0, 0, 0)] = undecorated;
+	}
+
+	Chunk* undecoratedAbove = nullptr;
+	if (isAboveSaved)
+	{
+		undecoratedAbove = generateUndecorated({ chunk.x, chunk.y + 1, chunk.z }, column, seed, cache);
+		scratchNeighbourhood[getNeighbourhoodIndex(0, 1, 0)] = undecoratedAbove;
+	}
+
+	generateDecorations(scratchNeighbourhood, column, seed);
+
+	delete undecorated;
+	delete undecoratedAbove;
+}
+
+bool CWorldGenPipeline::Init(World* world, uint32_t workerCount, CWorldStorage* storage, CChunkCache* cache)
+{
+	_world = world;
+	_storage = storage;
+	_cache = cache;
+	_jobsInFlight = 0;
+
+	if (mtx_init(&_finishedMutex, mtx_plain) != thrd_success)
+	{
+		TRACE("Could not create world gen mutex");
+		return false;
+	}
+
+	if (!_jobSystem.Init(workerCount))
+	{
+		TRACE("Could not start world gen workers");
+		mtx_destroy(&_finishedMutex);
+		return false;
+	}
+
+	return true;
+}
+
+void CWorldGenPipeline::Deinit()
+{
+	_jobSystem.Deinit(CancelJob);
+
+	for (Job* job : _finishedJobs)
+	{
+		delete job;
+	}
+	_finishedJobs.clear();
+	_entries.clear();
+
+	mtx_destroy(&_finishedMutex);
+}
+
+void CWorldGenPipeline::Request(const ChunkCoord& coord)
+{
+	if (!isInsideWorld(coord))
+		return;
+
+	// Complete means no neighbour decorates anymore, so all of them have to get there too
+	for (int32_t z = -1; z <= 1; ++z)
+	{
+		for (int32_t y = -1; y <= 1; ++y)
+		{
+			for (int32_t x = -1; x <= 1; ++x)
+			{
+				EnsureStage({ coord.x + x, coord.y + y, coord.z + z }, GenStageDecorated);
+			}
+		}
+	}
+
+	GetOrCreateEntry(coord).isRequested = true;
+}
+
+void CWorldGenPipeline::Update(std::vector<Chunk*>& outCompleted)
+{
+	ZoneScoped;
+
+	mtx_lock(&_finishedMutex);
+	_finishedJobsScratch.swap(_finishedJobs);
+	mtx_unlock(&_finishedMutex);
+
+	for (Job* job : _finishedJobsScratch)
+	{
+		Entry* entry = FindEntry(job->coord);
+		entry->stage = job->stage;
+		entry->isSaved = entry->isSaved || job->isSaved;
+		if (!job->diff.empty())
+		{
+			entry->diff.swap(job->diff);
+		}
+		SetNeighbourhoodLocked(job->coord, getStageRadius(job->stage), false);
+
+		--_jobsInFlight;
+		delete job;
+	}
+	_finishedJobsScratch.clear();
+
+	for (auto& it : _entries)
+	{
+		Entry& entry = it.second;
+		if (!entry.isLocked && entry.stage < entry.targetStage)
+		{
+			TrySchedule(it.first, entry);
+		}
+	}
+
+	for (auto& it : _entries)
+	{
+		Entry& entry = it.second;
+		if (entry.isRequested && !entry.isCompleted && IsComplete(it.first))
+		{
+			entry.isCompleted = true;
+			entry.chunk->isComplete = true;
+
+			for (const VoxelEdit& edit : entry.diff)
+			{
+				entry.chunk->blocks[edit.voxelIndex] = edit.block;
+				markVoxelEdited(*entry.chunk, edit.voxelIndex);
+			}
+			entry.diff.clear();
+			entry.diff.shrink_to_fit();
+
+			updateChunkOccupancy(*entry.chunk);
+			updateColumnInfo(*entry.column, *entry.chunk);
+			outCompleted.push_back(entry.chunk);
+		}
+	}
+}
+
+void CWorldGenPipeline::RunJob(void* userData)
+{
+	ZoneScoped;
+
+	Job* job = static_cast<Job*>(userData);
+	CWorldGenPipeline* pipeline = job->pipeline;
+	Chunk& chunk = *job->neighbourhood[getNeighbourhoodIndex(0, 0, 0)];
+	const uint32_t seed = pipeline->_world->seed;
+
+	switch (job->stage)
+	{
+	case GenStageDensity:
+		if (pipeline->_storage && pipeline->_storage->LoadChunk(chunk, job->diff) == RegionChunkFull)
+		{
+			// Stays in full when saved again. Its own decorations still have to reach the neighbours, which
+			// are generated again
+			chunk.editMask.assign(ChunkVoxelCount / 64, ~uint64_t(0));
+			job->stage = GenStageCaves;
+			job->isSaved = true;
+			break;
+		}
+		if (pipeline->_cache && pipeline->_cache->Load(seed, chunk))
+		{
+			job->stage = GenStageCaves;
+			break;
+		}
+		generateDensity(chunk, *job->column, seed);
+		break;
+	case GenStageSurface:
+		generateSurface(chunk, *job->column, seed);
+		break;
+	case GenStageCaves:
+		generateCaves(chunk, seed);
+		if (pipeline->_cache)
+		{
+			pipeline->_cache->Store(seed, chunk);
+		}
+		break;
+	case GenStageDecorated:
+		if (job->isSaved || job->isAboveSaved)
+		{
+			decorateNearSavedChunks(job->neighbourhood, *job->column, seed, pipeline->_cache, job->isSaved, job->isAboveSaved);
+			break;
+		}
+		generateDecorations(job->neighbourhood, *job->column, seed);
+		break;
+	}
+
+	mtx_lock(&pipeline->_finishedMutex);
+	pipeline->_finishedJobs.push_back(job);
+	mtx_unlock(&pipeline->_finishedMutex);
+}
+
+void CWorldGenPipeline::CancelJob(void* userData)
+{
+	delete static_cast<Job*>(userData);
+}
+
+CWorldGenPipeline::Entry* CWorldGenPipeline::FindEntry(const ChunkCoord& coord)
+{
+	auto it = _entries.find(coord);
+	return it != _entries.end() ? &it->second : nullptr;
+}
+
+CWorldGenPipeline::Entry& CWorldGenPipeline::GetOrCreateEntry(const ChunkCoord& coord)
+{
+	auto it = _entries.find(coord);
+	if (it != _entries.end())
+		return it->second;
+
+	Chunk* chunk = new Chunk();
+	chunk->x = coord.x;
+	chunk->y = coord.y;
+	chunk->z = coord.z;
+	chunk->blocks.resize(ChunkVoxelCount);
+	_world->chunks[coord] = chunk;
+
+	Entry entry = {};
+	entry.chunk = chunk;
+	entry.column = GetOrCreateColumn(coord.x, coord.z);
+	entry.stage = GenStageNone;
+	entry.targetStage = GenStageNone;
+	return _entries.emplace(coord, entry).first->second;
+}
+
+ChunkColumn* CWorldGenPipeline::GetOrCreateColumn(int32_t x, int32_t z)
+{
+	ChunkColumn* column = findColumn(*_world, { x, z });
+	if (column)
+		return column;
+
+	// Only a few 2D noise rows, cheap enough to do right away on the main thread before any job needs it
+	column = new ChunkColumn();
+	column->x = x;
+	column->z = z;
+	generateColumn(*column, _world->seed);
+	_world->columns[{ x, z }] = column;
+	return column;
+}
+
+void CWorldGenPipeline::EnsureStage(const ChunkCoord& coord, uint8_t stage)
+{
+	if (!isInsideWorld(coord))
+		return;
+
+	Entry& entry = GetOrCreateEntry(coord);
+	if (entry.targetStage >= stage)
+		return;
+
+	entry.targetStage = stage;
+
+	const int32_t radius = getStageRadius(stage);
+	for (int32_t z = -radius; z <= radius; ++z)
+	{
+		for (int32_t y = -radius; y <= radius; ++y)
+		{
+			for (int32_t x = -radius; x <= radius; ++x)
+			{
+				if (x != 0 || y != 0 || z != 0)
+				{
+					EnsureStage({ coord.x + x, coord.y + y, coord.z + z }, stage - 1);
+				}
+			}
+		}
+	}
+}
+
+bool CWorldGenPipeline::TrySchedule(const ChunkCoord& coord, Entry& entry)
+{
+	const uint8_t stage = entry.stage + 1;
+	const int32_t radius = getStageRadius(stage);
+
+	Job* job = nullptr;
+
+	for (int32_t pass = 0; pass < 2; ++pass)
+	{
+		for (int32_t z = -radius; z <= radius; ++z)
+		{
+			for (int32_t y = -radius; y <= radius; ++y)
+			{
+				for (int32_t x = -radius; x <= radius; ++x)
+				{
+					const ChunkCoord neighbourCoord = { coord.x + x, coord.y + y, coord.z + z };
+					if (!isInsideWorld(neighbourCoord))
+						continue;
+
+					Entry* neighbour = FindEntry(neighbourCoord);
+					if (pass == 0)
+					{
+						// Every neighbour has to be idle and done with the previous stage
+						if (!neighbour || neighbour->isLocked || neighbour->stage + 1 < stage)
+							return false;
+					}
+					else if (!neighbour->isSaved || neighbour == &entry)
+					{
+						job->neighbourhood[getNeighbourhoodIndex(x, y, z)] = neighbour->chunk;
+					}
+					else if (x == 0 && y == 1 && z == 0)
+					{
+						job->isAboveSaved = true;
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			job = new Job();
+			job->pipeline = this;
+			job->coord = coord;
+			job->stage = stage;
+			job->isSaved = entry.isSaved;
+			job->isAboveSaved = false;
+			job->column = entry.column;
+			for (Chunk*& neighbour : job->neighbourhood)
+			{
+				neighbour = nullptr;
+			}
+		}
+	}
+
+	SetNeighbourhoodLocked(coord, radius, true);
+	++_jobsInFlight;
+	_jobSystem.Push(RunJob, job);
+	return true;
+}
+
+void CWorldGenPipeline::SetNeighbourhoodLocked(const ChunkCoord& coord, int32_t radius, bool isLocked)
+{
+	for (int32_t z = -radius; z <= radius; ++z)
+	{
+		for (int32_t y = -radius; y <= radius; ++y)
+		{
+			for (int32_t x = -radius; x <= radius; ++x)
+			{
+				Entry* entry = FindEntry({ coord.x + x, coord.y + y, coord.z + z });
+				if (entry)
+				{
+					entry->isLocked = isLocked;
+				}
+			}
+		}
+	}
+}
+
+bool CWorldGenPipeline::IsComplete(const ChunkCoord& coord)
+{
+	for (int32_t z = -1; z <= 1; ++z)
+	{
+		for (int32_t y = -1; y <= 1; ++y)
+		{
+			for (int32_t x = -1; x <= 1; ++x)
+			{
+				const ChunkCoord neighbourCoord = { coord.x + x, coord.y + y, coord.z + z };
+				if (!isInsideWorld(neighbourCoord))
+					continue;
+
+				const Entry* entry = FindEntry(neighbourCoord);
+				if (!entry || entry->isLocked || entry->stage < GenStageDecorated)
+					return false;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "chunkcache.h"
+#include "../jobs.h"
+#include "../storage.h"
+#include "../world.h"
+
+#include <threads.h>
+
+#include <unordered_map>
+#include <vector>
+
+// Stages a chunk goes through, in order
+enum GenStage : uint8_t
+{
+	GenStageNone,
+	GenStageDensity,
+	GenStageSurface,
+	GenStageCaves,
+	GenStageDecorated,
+	GenStageCount
+};
+
+// Runs the generation stages of the world's chunks on worker threads. A stage only runs once the
+// chunk finished the previous stage and so did every neighbour within the radius the stage reads
+// or writes. While a stage runs, the chunk and those neighbours are locked, so every chunk is
+// touched by one job at a time and no locking is needed on the block data itself.
+class CWorldGenPipeline
+{
+public:
+	// Storage and cache are optional. Chunks saved as diffs are generated and patched once complete.
+	// Chunks saved in full are loaded as they are instead of generated and are never written by the
+	// decorations of their neighbours, their own decorations are generated again for the neighbours. Chunks found in the cache skip the chunk local stages.
+	bool Init(World* world, uint32_t workerCount, CWorldStorage* storage = nullptr, CChunkCache* cache = nullptr);
+	void Deinit();
+
+	// Asks for a chunk to be complete: decorated, with all neighbours decorated too so nothing
+	// spills into it anymore. Chunks outside of the world height are ignored
+	void Request(const ChunkCoord& coord);
+
+	// Collects finished stages and schedules the next ones, call from the main thread every frame.
+	// outCompleted receives the requested chunks that became complete since the last call
+	void Update(std::vector<Chunk*>& outCompleted);
+
+	uint32_t GetJobsInFlight() const { return _jobsInFlight; }
+
+private:
+	struct Entry
+	{
+		Chunk* chunk;
+		ChunkColumn* column;
+		uint8_t stage;
+		uint8_t targetStage;
+		bool isLocked;
+		bool isSaved;
+		bool isRequested;
+		bool isCompleted;
+		// Saved edits to apply once the chunk is complete
+		std::vector<VoxelEdit> diff;
+	};
+
+	struct Job
+	{
+		CWorldGenPipeline* pipeline;
+		ChunkCoord coord;
+		uint8_t stage;
+		bool isSaved;
+		// Only set for the decorations, the chunk above is saved in full
+		bool isAboveSaved;
+		std::vector<VoxelEdit> diff;
+		const ChunkColumn* column;
+		Chunk* neighbourhood[27];
+	};
+
+	static void RunJob(void* userData);
+	static void CancelJob(void* userData);
+
+	Entry* FindEntry(const ChunkCoord& coord);
+	Entry& GetOrCreateEntry(const ChunkCoord& coord);
+	ChunkColumn* GetOrCreateColumn(int32_t x, int32_t z);
+	void EnsureStage(const ChunkCoord& coord, uint8_t stage);
+	bool TrySchedule(const ChunkCoord& coord, Entry& entry);
+	void SetNeighbourhoodLocked(const ChunkCoord& coord, int32_t radius, bool isLocked);
+	bool IsComplete(const ChunkCoord& coord);
+
+	World* _world;
+	CWorldStorage* _storage;
+	CChunkCache* _cache;
+	CJobSystem _jobSystem;
+	std::unordered_map<ChunkCoord, Entry, ChunkCoordHash> _entries;
+	uint32_t _jobsInFlight = 0;
+
+	mtx_t _finishedMutex;
+	std::vector<Job*> _finishedJobs;
+	std::vector<Job*> _finishedJobsScratch;
+};
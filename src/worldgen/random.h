@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../simd.h"
+
+#include <stdint.h>
+
+// Stateless random numbers for world generation. Every number is a hash of a key and a counter,
+// so there is no state to seed or carry around, any number can be computed on its own and the
+// results don't depend on the order or thread they are computed on.
+
+// Streams of independent numbers within one chunk
+enum RandomStream : uint32_t
+{
+	RandomStreamOres,
+	RandomStreamTrees,
+};
+
+inline uint32_t mixRandom(uint32_t value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= value >> 15;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+inline uint4 mixRandom(uint4 value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= value >> 15;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+// Key of one stream of one chunk
+inline uint32_t getRandomKey(uint32_t seed, int32_t chunkX, int32_t chunkY, int32_t chunkZ, RandomStream stream)
+{
+	uint32_t key = mixRandom(seed ^ stream * 0x9e3779b9u);
+	key = mixRandom(key ^ static_cast<uint32_t>(chunkX));
+	key = mixRandom(key ^ static_cast<uint32_t>(chunkY));
+	key = mixRandom(key ^ static_cast<uint32_t>(chunkZ));
+	return key;
+}
+
+// The counter'th number of a stream, usually a voxel index or an item number
+inline uint32_t getRandom(uint32_t key, uint32_t counter)
+{
+	return mixRandom(key + counter * 0x9e3779b9u);
+}
+
+inline uint4 getRandom(uint32_t key, uint4 counters)
+{
+	return mixRandom(splat4(key) + counters * 0x9e3779b9u);
+}
+
+// Maps a random number to [min, max] without a division
+inline int32_t getRandomRange(uint32_t random, int32_t min, int32_t max)
+{
+	const uint64_t range = static_cast<uint64_t>(max - min) + 1;
+	return min + static_cast<int32_t>((random * range) >> 32);
+}
@@ -0,0 +1,395 @@
+#include "worldgen.h"
+#include "noise.h"
+#include "random.h"
+#include "../block.h"
+#include "../chunk.h"
+#include "../simd.h"
+
+// Terrain shape
+constexpr float TerrainBaseHeight = 32.0f;
+constexpr float TerrainHeightRange = 20.0f;
+constexpr float TerrainHeightScale = 1.0f / 96.0f;
+constexpr uint32_t TerrainHeightOctaves = 4;
+
+// Humidity varies slowly between biomes and decides how many trees grow
+constexpr float HumidityScale = 1.0f / 384.0f;
+constexpr uint32_t HumidityOctaves = 2;
+
+// 3D density adds overhangs and floating bits on top of the height map
+constexpr float DensityScale = 1.0f / 24.0f;
+constexpr float DensityStrength = 10.0f;
+
+// Number of dirt blocks below the grass
+constexpr uint32_t DirtDepth = 3;
+
+// Caves
+constexpr float CaveRadius = 0.08f;
+constexpr int32_t CaveMinHeight = 2;
+
+// Decorations
+constexpr uint32_t OreRarity = 200;
+constexpr uint32_t MaxTreesPerChunk = 4;
+constexpr int32_t TreeMinHeight = 4;
+constexpr int32_t TreeMaxHeight = 6;
+
+// Density is sampled on a coarse lattice and trilinearly interpolated in between
+constexpr size_t LatticeStep = 4;
+constexpr size_t LatticeWidth = ChunkWidth / LatticeStep + 1;
+constexpr size_t LatticeHeight = ChunkHeight / LatticeStep + 1;
+constexpr size_t LatticeDepth = ChunkDepth / LatticeStep + 1;
+constexpr size_t LatticePointCount = LatticeWidth * LatticeHeight * LatticeDepth;
+constexpr size_t LatticeBatchCount = (LatticePointCount + 3) & ~size_t(3);
+
+static_assert(ChunkWidth % 16 == 0 && LatticeStep == 4, "Rows are processed as 4 lanes per lattice cell");
+
+static uint32_t getSubSeed(uint32_t seed, uint32_t salt)
+{
+	uint32_t hash = seed ^ (salt * 0x9e3779b9u);
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+void generateColumn(ChunkColumn& column, uint32_t seed)
+{
+	const int32_t columnX = column.x * static_cast<int32_t>(ChunkWidth);
+	const int32_t columnZ = column.z * static_cast<int32_t>(ChunkDepth);
+
+	float heightX[ChunkWidth * ChunkDepth];
+	float heightZ[ChunkWidth * ChunkDepth];
+	float humidityX[ChunkWidth * ChunkDepth];
+	float humidityZ[ChunkWidth * ChunkDepth];
+
+	for (size_t z = 0; z < ChunkDepth; ++z)
+	{
+		for (size_t x = 0; x < ChunkWidth; ++x)
+		{
+			const float worldX = static_cast<float>(columnX + static_cast<int32_t>(x));
+			const float worldZ = static_cast<float>(columnZ + static_cast<int32_t>(z));
+			heightX[z * ChunkWidth + x] = worldX * TerrainHeightScale;
+			heightZ[z * ChunkWidth + x] = worldZ * TerrainHeightScale;
+			humidityX[z * ChunkWidth + x] = worldX * HumidityScale;
+			humidityZ[z * ChunkWidth + x] = worldZ * HumidityScale;
+		}
+	}
+
+	float* heights = &column.terrainHeights[0][0];
+	fractalNoise2D(getSubSeed(seed, 1), heightX, heightZ, heights, ChunkWidth * ChunkDepth, TerrainHeightOctaves, 2.0f, 0.5f);
+
+	for (size_t sampleIt = 0; sampleIt < ChunkWidth * ChunkDepth; sampleIt += 4)
+	{
+		store4(heights + sampleIt, load4(heights + sampleIt) * TerrainHeightRange + TerrainBaseHeight);
+	}
+
+	fractalNoise2D(getSubSeed(seed, 5), humidityX, humidityZ, &column.humidity[0][0], ChunkWidth * ChunkDepth, HumidityOctaves, 2.0f, 0.5f);
+
+	for (size_t z = 0; z < ChunkDepth; ++z)
+	{
+		for (size_t x = 0; x < ChunkWidth; ++x)
+		{
+			column.columns[z][x].height = EmptyColumnHeight;
+			column.columns[z][x].topBlock = BlockAir;
+		}
+	}
+}
+
+static void generateDensityLattice(int32_t chunkX, int32_t chunkY, int32_t chunkZ, uint32_t seed, float outLattice[LatticeBatchCount])
+{
+	float sampleX[LatticeBatchCount] = {};
+	float sampleY[LatticeBatchCount] = {};
+	float sampleZ[LatticeBatchCount] = {};
+
+	size_t pointIt = 0;
+	for (size_t z = 0; z < LatticeDepth; ++z)
+	{
+		for (size_t y = 0; y < LatticeHeight; ++y)
+		{
+			for (size_t x = 0; x < LatticeWidth; ++x)
+			{
+				sampleX[pointIt] = static_cast<float>(chunkX + static_cast<int32_t>(x * LatticeStep)) * DensityScale;
+				sampleY[pointIt] = static_cast<float>(chunkY + static_cast<int32_t>(y * LatticeStep)) * DensityScale;
+				sampleZ[pointIt] = static_cast<float>(chunkZ + static_cast<int32_t>(z * LatticeStep)) * DensityScale;
+				++pointIt;
+			}
+		}
+	}
+
+	gradientNoise3D(getSubSeed(seed, 2), sampleX, sampleY, sampleZ, outLattice, LatticeBatchCount);
+}
+
+static float getLatticeValue(const float lattice[LatticeBatchCount], size_t x, size_t y, size_t z)
+{
+	return lattice[x + LatticeWidth * (y + LatticeHeight * z)];
+}
+
+// Interpolates the lattice in y and z for one row of voxels, leaving the LatticeWidth values along x
+static void interpolateLatticeRow(const float lattice[LatticeBatchCount], size_t y, size_t z, float outRow[LatticeWidth])
+{
+	const size_t latticeY = y / LatticeStep;
+	const size_t latticeZ = z / LatticeStep;
+	const float fracY = static_cast<float>(y % LatticeStep) / LatticeStep;
+	const float fracZ = static_cast<float>(z % LatticeStep) / LatticeStep;
+
+	const size_t nextY = latticeY + (fracY > 0.0f ? 1 : 0);
+	const size_t nextZ = latticeZ + (fracZ > 0.0f ? 1 : 0);
+
+	for (size_t x = 0; x < LatticeWidth; ++x)
+	{
+		const float v00 = getLatticeValue(lattice, x, latticeY, latticeZ);
+		const float v10 = getLatticeValue(lattice, x, nextY, latticeZ);
+		const float v01 = getLatticeValue(lattice, x, latticeY, nextZ);
+		const float v11 = getLatticeValue(lattice, x, nextY, nextZ);
+
+		const float v0 = v00 + (v10 - v00) * fracY;
+		const float v1 = v01 + (v11 - v01) * fracY;
+		outRow[x] = v0 + (v1 - v0) * fracZ;
+	}
+}
+
+// Density of one row of ChunkWidth voxels, positive is solid
+static void computeDensityRow(const float latticeRow[LatticeWidth], const float* heights, float worldY, float4 outDensity[ChunkWidth / 4])
+{
+	const float4 fracX = float4{ 0.0f, 0.25f, 0.5f, 0.75f };
+
+	for (size_t cell = 0; cell < ChunkWidth / 4; ++cell)
+	{
+		const float4 noise = splat4(latticeRow[cell]) + (splat4(latticeRow[cell + 1]) - splat4(latticeRow[cell])) * fracX;
+		outDensity[cell] = load4(heights + cell * 4) - worldY + noise * DensityStrength;
+	}
+}
+
+void generateDensity(Chunk& chunk, const ChunkColumn& column, uint32_t seed)
+{
+	const int32_t chunkX = chunk.x * static_cast<int32_t>(ChunkWidth);
+	const int32_t chunkY = chunk.y * static_cast<int32_t>(ChunkHeight);
+	const int32_t chunkZ = chunk.z * static_cast<int32_t>(ChunkDepth);
+
+	float lattice[LatticeBatchCount];
+	generateDensityLattice(chunkX, chunkY, chunkZ, seed, lattice);
+
+	// One row along x at a time
+	for (size_t z = 0; z < ChunkDepth; ++z)
+	{
+		for (size_t y = 0; y < ChunkHeight; ++y)
+		{
+			float latticeRow[LatticeWidth];
+			interpolateLatticeRow(lattice, y, z, latticeRow);
+
+			float4 density[ChunkWidth / 4];
+			computeDensityRow(latticeRow, column.terrainHeights[z], static_cast<float>(chunkY + static_cast<int32_t>(y)), density);
+
+			uint32_t* row = &chunk.blocks[getVoxelIndex(0, y, z)];
+			for (size_t cell = 0; cell < ChunkWidth / 4; ++cell)
+			{
+				const uint4 isSolid = reinterpret_cast<uint4>(density[cell] > 0.0f);
+				store4(row + cell * 4, isSolid & splat4(static_cast<uint32_t>(BlockStone)));
+			}
+		}
+	}
+}
+
+void generateSurface(Chunk& chunk, const ChunkColumn& column, uint32_t seed)
+{
+	const int32_t chunkX = chunk.x * static_cast<int32_t>(ChunkWidth);
+	const int32_t chunkY = chunk.y * static_cast<int32_t>(ChunkHeight);
+	const int32_t chunkZ = chunk.z * static_cast<int32_t>(ChunkDepth);
+
+	// The density one block above the chunk comes from the top of the lattice, it is the same value
+	// the chunk above computes for its bottom row but doesn't depend on how far that chunk got
+	float lattice[LatticeBatchCount];
+	generateDensityLattice(chunkX, chunkY, chunkZ, seed, lattice);
+
+	uint32_t* blocks = chunk.blocks.data();
+
+	for (size_t z = 0; z < ChunkDepth; ++z)
+	{
+		float aboveRow[LatticeWidth];
+		interpolateLatticeRow(lattice, ChunkHeight, z, aboveRow);
+
+		float4 aboveDensity[ChunkWidth / 4];
+		computeDensityRow(aboveRow, column.terrainHeights[z], static_cast<float>(chunkY + static_cast<int32_t>(ChunkHeight)), aboveDensity);
+
+		for (size_t x = 0; x < ChunkWidth; ++x)
+		{
+			uint32_t depth = aboveDensity[x / 4][x % 4] > 0.0f ? DirtDepth + 1 : 0;
+
+			for (size_t y = ChunkHeight; y-- > 0;)
+			{
+				uint32_t& block = blocks[getVoxelIndex(x, y, z)];
+				if (block == BlockAir)
+				{
+					depth = 0;
+					continue;
+				}
+
+				if (depth == 0)
+					block = BlockGrass;
+				else if (depth <= DirtDepth)
+					block = BlockDirt;
+
+				++depth;
+			}
+		}
+	}
+}
+
+void generateCaves(Chunk& chunk, uint32_t seed)
+{
+	const int32_t chunkX = chunk.x * static_cast<int32_t>(ChunkWidth);
+	const int32_t chunkY = chunk.y * static_cast<int32_t>(ChunkHeight);
+	const int32_t chunkZ = chunk.z * static_cast<int32_t>(ChunkDepth);
+
+	// Tunnels run where two independent noise fields are both close to zero
+	float latticeA[LatticeBatchCount];
+	float latticeB[LatticeBatchCount];
+	generateDensityLattice(chunkX, chunkY, chunkZ, getSubSeed(seed, 3), latticeA);
+	generateDensityLattice(chunkX, chunkY, chunkZ, getSubSeed(seed, 4), latticeB);
+
+	const float4 fracX = float4{ 0.0f, 0.25f, 0.5f, 0.75f };
+	const float4 threshold = splat4(CaveRadius * CaveRadius);
+
+	for (size_t z = 0; z < ChunkDepth; ++z)
+	{
+		for (size_t y = 0; y < ChunkHeight; ++y)
+		{
+			// Keep the bottom of the world closed
+			if (chunkY + static_cast<int32_t>(y) < CaveMinHeight)
+				continue;
+
+			float rowA[LatticeWidth];
+			float rowB[LatticeWidth];
+			interpolateLatticeRow(latticeA, y, z, rowA);
+			interpolateLatticeRow(latticeB, y, z, rowB);
+
+			uint32_t* row = &chunk.blocks[getVoxelIndex(0, y, z)];
+			for (size_t cell = 0; cell < ChunkWidth / 4; ++cell)
+			{
+				const float4 a = splat4(rowA[cell]) + (splat4(rowA[cell + 1]) - splat4(rowA[cell])) * fracX;
+				const float4 b = splat4(rowB[cell]) + (splat4(rowB[cell + 1]) - splat4(rowB[cell])) * fracX;
+				const uint4 isCave = reinterpret_cast<uint4>(a * a + b * b < threshold);
+				store4(row + cell * 4, load4(row + cell * 4) & ~isCave);
+			}
+		}
+	}
+}
+
+// Position relative to the centre chunk of the neighbourhood, may be up to one chunk outside of it
+static uint32_t* getNeighbourhoodBlock(Chunk* const neighbourhood[27], int32_t x, int32_t y, int32_t z)
+{
+	const int32_t offsetX = x < 0 ? -1 : (x >= static_cast<int32_t>(ChunkWidth) ? 1 : 0);
+	const int32_t offsetY = y < 0 ? -1 : (y >= static_cast<int32_t>(ChunkHeight) ? 1 : 0);
+	const int32_t offsetZ = z < 0 ? -1 : (z >= static_cast<int32_t>(ChunkDepth) ? 1 : 0);
+
+	Chunk* chunk = neighbourhood[getNeighbourhoodIndex(offsetX, offsetY, offsetZ)];
+	if (!chunk)
+		return nullptr;
+
+	const size_t localX = static_cast<size_t>(x - offsetX * static_cast<int32_t>(ChunkWidth));
+	const size_t localY = static_cast<size_t>(y - offsetY * static_cast<int32_t>(ChunkHeight));
+	const size_t localZ = static_cast<size_t>(z - offsetZ * static_cast<int32_t>(ChunkDepth));
+	return &chunk->blocks[getVoxelIndex(localX, localY, localZ)];
+}
+
+static bool isDecorationBlock(uint32_t block)
+{
+	return block == BlockLeaves || block == BlockLog;
+}
+
+// Decorations only go into air or replace lower priority decorations, so the outcome is the
+// same no matter in which order overlapping decorations of neighbouring chunks are placed
+static void placeDecoration(Chunk* const neighbourhood[27], int32_t x, int32_t y, int32_t z, uint32_t block)
+{
+	uint32_t* target = getNeighbourhoodBlock(neighbourhood, x, y, z);
+	if (target && (*target == BlockAir || (isDecorationBlock(*target) && *target < block)))
+	{
+		*target = block;
+	}
+}
+
+static void placeTree(Chunk* const neighbourhood[27], int32_t x, int32_t y, int32_t z, int32_t trunkHeight)
+{
+	const int32_t top = y + trunkHeight;
+
+	for (int32_t leafY = top - 2; leafY <= top + 1; ++leafY)
+	{
+		const int32_t radius = leafY > top - 1 ? 1 : 2;
+		for (int32_t leafZ = z - radius; leafZ <= z + radius; ++leafZ)
+		{
+			for (int32_t leafX = x - radius; leafX <= x + radius; ++leafX)
+			{
+				placeDecoration(neighbourhood, leafX, leafY, leafZ, BlockLeaves);
+			}
+		}
+	}
+
+	for (int32_t trunkY = y; trunkY < top; ++trunkY)
+	{
+		placeDecoration(neighbourhood, x, trunkY, z, BlockLog);
+	}
+}
+
+void generateDecorations(Chunk* const neighbourhood[27], const ChunkColumn& column, uint32_t seed)
+{
+	Chunk& chunk = *neighbourhood[getNeighbourhoodIndex(0, 0, 0)];
+
+	// Ores only replace stone of the chunk itself, rolled with one number per voxel
+	const uint32_t oreKey = getRandomKey(seed, chunk.x, chunk.y, chunk.z, RandomStreamOres);
+	const uint32_t oreChance = UINT32_MAX / OreRarity;
+	const uint4 stone = splat4(static_cast<uint32_t>(BlockStone));
+	uint32_t* chunkBlocks = chunk.blocks.data();
+
+	for (size_t voxelIt = 0; voxelIt < ChunkVoxelCount; voxelIt += 4)
+	{
+		const uint4 blocks = load4(&chunkBlocks[voxelIt]);
+		const uint4 roll = getRandom(oreKey, splat4(static_cast<uint32_t>(voxelIt)) + uint4{ 0, 1, 2, 3 });
+
+		const uint4 isStone = reinterpret_cast<uint4>(blocks == stone);
+		const uint4 isCoal = reinterpret_cast<uint4>(roll < oreChance);
+		const uint4 isIron = reinterpret_cast<uint4>(roll - oreChance < oreChance);
+
+		const uint4 ore = (isCoal & splat4(static_cast<uint32_t>(BlockCoalOre))) | (isIron & splat4(static_cast<uint32_t>(BlockIronOre)));
+		store4(&chunkBlocks[voxelIt], (blocks & ~(isStone & (isCoal | isIron))) | (isStone & ore));
+	}
+
+	// Trees grow on the highest grass block of a few random columns and can reach into the neighbours
+	const uint32_t treeKey = getRandomKey(seed, chunk.x, chunk.y, chunk.z, RandomStreamTrees);
+	for (uint32_t treeIt = 0; treeIt < MaxTreesPerChunk; ++treeIt)
+	{
+		const int32_t x = getRandomRange(getRandom(treeKey, treeIt * 3 + 0), 0, static_cast<int32_t>(ChunkWidth) - 1);
+		const int32_t z = getRandomRange(getRandom(treeKey, treeIt * 3 + 1), 0, static_cast<int32_t>(ChunkDepth) - 1);
+		const int32_t trunkHeight = getRandomRange(getRandom(treeKey, treeIt * 3 + 2), TreeMinHeight, TreeMaxHeight);
+
+		// Dry biomes get fewer trees
+		const float humidity = column.humidity[z][x];
+		if (humidity * 0.5f + 0.5f < static_cast<float>(treeIt) / MaxTreesPerChunk)
+			continue;
+
+		for (int32_t y = static_cast<int32_t>(ChunkHeight) - 1; y >= 0; --y)
+		{
+			const uint32_t block = chunk.blocks[getVoxelIndex(x, y, z)];
+			if (block == BlockAir || isDecorationBlock(block))
+				continue;
+
+			// Decorations of other chunks may already be above, they count as free space
+			const uint32_t* above = getNeighbourhoodBlock(neighbourhood, x, y + 1, z);
+			if (block == BlockGrass && above && (*above == BlockAir || isDecorationBlock(*above)))
+			{
+				placeTree(neighbourhood, x, y + 1, z, trunkHeight);
+			}
+			break;
+		}
+	}
+}
+
+void generateTerrain(Chunk& chunk, uint32_t seed)
+{
+	ChunkColumn column;
+	column.x = chunk.x;
+	column.z = chunk.z;
+	generateColumn(column, seed);
+
+	generateDensity(chunk, column, seed);
+	generateSurface(chunk, column, seed);
+	generateCaves(chunk, seed);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+struct Chunk;
+struct ChunkColumn;
+
+// Bump whenever a change alters the generated blocks for a given seed
+constexpr uint32_t WorldGenVersion = 4;
+
+// Fills the generation inputs shared by all chunks of a column and resets its column info, the
+// column coordinates have to be set. Runs once before any chunk of the column is generated.
+void generateColumn(ChunkColumn& column, uint32_t seed);
+
+// Generation stages, each one runs on a chunk whose coordinates are set and that went through the
+// previous stages. The chunk local stages only depend on the seed, the chunk coordinates and the column.
+void generateDensity(Chunk& chunk, const ChunkColumn& column, uint32_t seed);
+void generateSurface(Chunk& chunk, const ChunkColumn& column, uint32_t seed);
+void generateCaves(Chunk& chunk, uint32_t seed);
+
+// Decorations write into the 26 neighbours of the centre chunk of the neighbourhood, which have to be
+// through generateCaves() already. Missing neighbours (outside of the world) can be null.
+void generateDecorations(Chunk* const neighbourhood[27], const ChunkColumn& column, uint32_t seed);
+
+// Runs all chunk local stages, everything but the decorations
+void generateTerrain(Chunk& chunk, uint32_t seed);
+
+inline int32_t getNeighbourhoodIndex(int32_t offsetX, int32_t offsetY, int32_t offsetZ)
+{
+	return (offsetX + 1) + 3 * ((offsetY + 1) + 3 * (offsetZ + 1));
+}